@@ -11,28 +11,19 @@
 #endif
 #include "scoring.h"
 #include "solution.h"
+#include "rng.h"
+#include "simulated_annealing.h"
+#include "spatial_grid.h"
+#include "impact_kernels.h"
+#include "attendee_pruning.h"
 
 using namespace std;
 
-class timer {
-    public:
-    void start() {
-        origin = chrono::system_clock::now();
-    }
-    
-    inline double get_time() {
-        auto current = chrono::system_clock::now();
-        return chrono::duration_cast<std::chrono::milliseconds>(current - origin).count() / 1000.;
-    }
-    
-    chrono::time_point<chrono::system_clock> origin;
-};
-
 class random {
     public:
     // [0, x)
     inline static unsigned get(unsigned x) {
-        return ((unsigned long long)xorshift() * x) >> 32;
+        return generator().get(x);
     }
     
     // [x, y]
@@ -42,12 +33,12 @@ class random {
     
     // [0, x] (x = 2^c - 1)
     inline static unsigned get_fast(unsigned x) {
-        return xorshift() & x;
+        return generator().get_fast(x);
     }
     
-    // [0.0, 1.0]
+    // (0.0, 1.0)
     inline static double probability() {
-        return xorshift() * INV_MAX;
+        return generator().probability();
     }
     
     inline static double get_double(double x, double y) {
@@ -55,17 +46,12 @@ class random {
     }
     
     inline static bool toss() {
-        return xorshift() & 1;
+        return generator().toss();
     }
     
-    private:
-    constexpr static double INV_MAX = 1.0 / 0xFFFFFFFF;
-    
-    inline static unsigned xorshift() {
-        static unsigned x = 123456789, y = 362436039, z = 521288629, w = 88675123;
-        unsigned t = x ^ (x << 11);
-        x = y, y = z, z = w;
-        return w = (w ^ (w >> 19)) ^ (t ^ (t >> 8));
+    // sa::random と同じ系列を使う (library/rng.h)。SEED 環境変数で系列を固定できる
+    static manarimo::rng& generator() {
+        return sa::random::generator();
     }
 };
 
@@ -77,60 +63,9 @@ const char* getenv_or(const char* varname, const char* fallback) {
 const double START_TEMP = atof(getenv_or("START_TEMP", "10000"));
 const double END_TEMP = atof(getenv_or("END_TEMP", "1e-9"));
 
-class simulated_annealing {
-    public:
-    simulated_annealing(double time_limit);
-    inline bool end();
-    inline bool accept(double current_score, double next_score);
-    void print() const;
-    
-    private:
-    constexpr static bool MAXIMIZE = true;
-    constexpr static int LOG_SIZE = 0xFFFF;
-    constexpr static int UPDATE_INTERVAL = 0xFF;
-    double time_limit;
-    double temp_ratio;
-    double log_probability[LOG_SIZE + 1];
-    long long iteration = 0;
-    long long accepted = 0;
-    long long rejected = 0;
-    double time = 0;
-    double temp = START_TEMP;
-    timer sa_timer;
-};
-
-simulated_annealing::simulated_annealing(double time_limit) : time_limit(time_limit) {
-    temp_ratio = (END_TEMP - START_TEMP) / time_limit;
-    sa_timer.start();
-    for (int i = 0; i <= LOG_SIZE; i++) log_probability[i] = log(random::probability());
-}
-
-inline bool simulated_annealing::end() {
-    iteration++;
-    if ((iteration & UPDATE_INTERVAL) == 0) {
-        time = sa_timer.get_time();
-        temp = START_TEMP + temp_ratio * time;
-        return time >= time_limit;
-    } else {
-        return false;
-    }
-}
-
-inline bool simulated_annealing::accept(double current_score, double next_score) {
-    double diff = (MAXIMIZE ? next_score - current_score : current_score - next_score);
-    if (diff >= 0 || diff > log_probability[random::get_fast(LOG_SIZE)] * temp) {
-        accepted++;
-        return true;
-    } else {
-        rejected++;
-        return false;
-    }
-}
-
-void simulated_annealing::print() const {
-    fprintf(stderr, "iteration: %lld\n", iteration);
-    fprintf(stderr, "accepted: %lld\n", accepted);
-    fprintf(stderr, "rejected: %lld\n", rejected);
+// START_TEMP から END_TEMP へ線形に冷やす。SA_* 環境変数で上書きできる (library/simulated_annealing.h)
+sa::schedule sa_schedule(double time_limit) {
+    return sa::schedule(time_limit, START_TEMP, END_TEMP).override_from_env();
 }
 
 const double INIT_TIME_LIMIT = atof(getenv_or("INIT_TIME_LIMIT", "10"));
@@ -150,6 +85,10 @@ const double max_diff_width = atof(getenv_or("MAX_DIFF_DISTANCE", "1"));
 const double max_diff_height = atof(getenv_or("MAX_DIFF_DISTANCE", "1"));
 vector<int> instrument[MAX_MUSICIAN];
 vector<geo::P> placements;
+// placements と同じ位置を持つ衝突判定用のグリッド
+manarimo::spatial_grid grid;
+// ステージの区画ごとに、遮蔽に関わりうる柱
+manarimo::pillar_index pillars;
 vector<pair<double, int>> attendee_angles[MAX_MUSICIAN];
 vector<int> blocked_attendees[MAX_MUSICIAN][MAX_MUSICIAN];
 int blocked_count[MAX_MUSICIAN][MAX_ATTENDEE];
@@ -164,7 +103,10 @@ vector<geo::P> best_placements;
 vector<double> volumes;
 
 void input() {
-    manarimo::load_problem(std::cin, problem);
+    // 得点に関係しない聴衆を除いておく (PRUNE_EPSILON が 0 なら得点は変わらない)
+    const manarimo::attendee_map pruned = manarimo::load_pruned_problem(std::cin, problem);
+    fprintf(stderr, "pruned attendees : %d hidden, %d negligible, %d left\n", pruned.n_hidden, pruned.n_negligible, (int) pruned.original_ids.size());
+    pillars.build(problem);
     
     stage_left = problem.stage_bottom_left.X;
     stage_right = stage_left + problem.stage_width;
@@ -175,6 +117,7 @@ void input() {
     stage_top = stage_bottom + problem.stage_height;
     stage_bottom += RADIUS;
     stage_top -= RADIUS;
+    grid.reset(stage_left, stage_bottom, stage_right - stage_left, stage_top - stage_bottom, RADIUS);
     
     for (int i = 0; i < problem.musicians.size(); i++) instrument[problem.musicians[i]].push_back(i);
 }
@@ -193,18 +136,13 @@ double dist(const geo::P& p1, const geo::P& p2) {
 
 void random_init() {
     placements.clear();
+    grid.build(placements);
     for (int i = 0; i < problem.musicians.size(); i++) {
         while (true) {
             geo::P p(random::get(stage_left, stage_right), random::get(stage_bottom, stage_top));
-            bool ng = false;
-            for (int j = 0; j < i; j++) {
-                if (dist2(placements[j], p) < RADIUS2) {
-                    ng = true;
-                    break;
-                }
-            }
-            if (!ng) {
+            if (!grid.collides(p, RADIUS2)) {
                 placements.push_back(p);
+                grid.insert(i, p);
                 break;
             }
         }
@@ -243,7 +181,7 @@ void calc_blocked_one(int musician, const geo::P& p, vector<pair<double, int>>&
             blocked_count[attendee_angles[index].second]++;
         }
     }
-    for (int i = 0; i < problem.pillars.size(); i++) {
+    for (int i : pillars.near(p)) {
         double angle = get_angle(p, problem.pillars[i].center);
         double offset = asin(problem.pillars[i].radius / dist(p, problem.pillars[i].center));
         double start = angle - offset;
@@ -311,11 +249,13 @@ double score_all_exact() {
 }
 
 double score_one_no_block(const geo::P& p, int musician) {
-    double sum = 0;
-    for (const manarimo::atendee_t& a : problem.attendees) {
-        sum += calc_one_score(p, a.pos, a.tastes[musician]);
-    }
-    return sum;
+    return manarimo::no_block_impact(problem.attendee_x_data, problem.attendee_y_data, problem.attendees.size(), p.X, p.Y, problem.tastes_by_instrument[musician]);
+}
+
+// p にいる演奏家の楽器が musician1 だったときと musician2 だったときの score_one_no_block を out[0], out[1] に入れる
+void score_two_no_block(const geo::P& p, int musician1, int musician2, double* out) {
+    const double* tastes[2] = {problem.tastes_by_instrument[musician1], problem.tastes_by_instrument[musician2]};
+    manarimo::no_block_impacts<2>(problem.attendee_x_data, problem.attendee_y_data, problem.attendees.size(), p.X, p.Y, tastes, out);
 }
 
 double score_all_no_block() {
@@ -330,6 +270,7 @@ void save_best_state() {
 
 void load_best_state() {
     placements = best_placements;
+    grid.build(placements);
     score_all_approximate();
 }
 
@@ -344,15 +285,17 @@ void sa_no_block() {
         }
     }
     placements = best_placements;
+    grid.build(placements);
     double current_score = best_score;
     
     int unchanged = 0;
-    simulated_annealing sa(INIT_TIME_LIMIT);
+    sa::simulated_annealing sa(sa_schedule(INIT_TIME_LIMIT));
     while (!sa.end()) {
         unchanged++;
         if (unchanged == 10000) {
             current_score = best_score;
             placements = best_placements;
+            grid.build(placements);
             unchanged = 0;
         }
         
@@ -364,21 +307,14 @@ void sa_no_block() {
             geo::P next_p = current_p;
             next_p.X += dx;
             next_p.Y += dy;
-            bool ng = false;
-            for (int i = 0; i < placements.size(); i++) {
-                if (i == m) continue;
-                if (dist2(placements[i], next_p) < RADIUS2) {
-                    ng = true;
-                    break;
-                }
-            }
-            if (ng) continue;
+            if (grid.collides(next_p, RADIUS2, m)) continue;
             double next_score = current_score;
             next_score -= score_one_no_block(current_p, problem.musicians[m]);
             next_score += score_one_no_block(next_p, problem.musicians[m]);
             if (sa.accept(current_score, next_score)) {
                 current_score = next_score;
                 placements[m] = next_p;
+                grid.move(m, next_p);
                 if (current_score > best_score) {
                     best_score = current_score;
                     best_placements = placements;
@@ -390,13 +326,17 @@ void sa_no_block() {
             int m2 = random::get(problem.musicians.size() - 1);
             if (m2 >= m1) m2++;
             double next_score = current_score;
-            next_score -= score_one_no_block(placements[m1], problem.musicians[m1]);
-            next_score -= score_one_no_block(placements[m2], problem.musicians[m2]);
-            next_score += score_one_no_block(placements[m1], problem.musicians[m2]);
-            next_score += score_one_no_block(placements[m2], problem.musicians[m1]);
+            double impact1[2], impact2[2];
+            score_two_no_block(placements[m1], problem.musicians[m1], problem.musicians[m2], impact1);
+            score_two_no_block(placements[m2], problem.musicians[m2], problem.musicians[m1], impact2);
+            next_score -= impact1[0];
+            next_score -= impact2[0];
+            next_score += impact1[1];
+            next_score += impact2[1];
             if (sa.accept(current_score, next_score)) {
                 current_score = next_score;
                 swap(placements[m1], placements[m2]);
+                grid.swap_positions(m1, m2);
                 if (current_score > best_score) {
                     best_score = current_score;
                     best_placements = placements;
@@ -413,18 +353,20 @@ int main(int argc, char *argv[]) {
     if (argc < 2) {
         sa_no_block();
         placements = best_placements;
+        grid.build(placements);
     } else {
         manarimo::solution_t intermediate_solution;
         manarimo::load_solution(string(argv[1]), intermediate_solution);
         best_placements = intermediate_solution.as_p();
         placements = best_placements;
+        grid.build(placements);
     }
     double best_score = score_all_approximate();
     double current_score = best_score;
     
     int unchanged = 0;
     vector<pair<int, int>> new_blocked;
-    simulated_annealing sa(MAIN_TIME_LIMIT);
+    sa::simulated_annealing sa(sa_schedule(MAIN_TIME_LIMIT));
     while (!sa.end()) {
         unchanged++;
         if (unchanged == 10000) {
@@ -441,15 +383,7 @@ int main(int argc, char *argv[]) {
             geo::P next_p = current_p;
             next_p.X += dx;
             next_p.Y += dy;
-            bool ng = false;
-            for (int i = 0; i < placements.size(); i++) {
-                if (i == m) continue;
-                if (dist2(placements[i], next_p) < RADIUS2) {
-                    ng = true;
-                    break;
-                }
-            }
-            if (ng) continue;
+            if (grid.collides(next_p, RADIUS2, m)) continue;
             int in = problem.musicians[m];
             for (int i = 0; i < problem.musicians.size(); i++) {
                 tmp_q[i] = q[i];
@@ -500,6 +434,7 @@ int main(int argc, char *argv[]) {
             if (sa.accept(current_score, next_score)) {
                 current_score = next_score;
                 placements[m] = next_p;
+                grid.move(m, next_p);
                 swap(attendee_angles[m], tmp_attendee_angles);
                 for (int i = 0; i < problem.musicians.size(); i++) blocked_attendees[m][i].swap(tmp_blocked_attendees[i]);
                 for (int i = 0; i < problem.attendees.size(); i++) blocked_count[m][i] = tmp_blocked_count[i];
@@ -563,6 +498,7 @@ int main(int argc, char *argv[]) {
             if (sa.accept(current_score, next_score)) {
                 current_score = next_score;
                 swap(placements[m1], placements[m2]);
+                grid.swap_positions(m1, m2);
                 attendee_angles[m1].swap(attendee_angles[m2]);
                 for (int i = 0; i < problem.musicians.size(); i++) {
                     if (i == m1 || i == m2) continue;
@@ -585,6 +521,7 @@ int main(int argc, char *argv[]) {
     }
     
     placements = best_placements;
+    grid.build(placements);
     best_score = score_all_exact();
     
     output(best_placements, volumes);
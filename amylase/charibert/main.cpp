@@ -11,28 +11,18 @@
 #endif
 #include "../../library/scoring.h"
 #include "../../library/solution.h"
+#include "../../library/rng.h"
+#include "../../library/simulated_annealing.h"
+#include "../../library/spatial_grid.h"
+#include "../../library/impact_kernels.h"
 
 using namespace std;
 
-class timer {
-    public:
-    void start() {
-        origin = chrono::system_clock::now();
-    }
-    
-    inline double get_time() {
-        auto current = chrono::system_clock::now();
-        return chrono::duration_cast<std::chrono::milliseconds>(current - origin).count() / 1000.;
-    }
-    
-    chrono::time_point<chrono::system_clock> origin;
-};
-
 class random {
     public:
     // [0, x)
     inline static unsigned get(unsigned x) {
-        return ((unsigned long long)xorshift() * x) >> 32;
+        return generator().get(x);
     }
     
     // [x, y]
@@ -42,12 +32,12 @@ class random {
     
     // [0, x] (x = 2^c - 1)
     inline static unsigned get_fast(unsigned x) {
-        return xorshift() & x;
+        return generator().get_fast(x);
     }
     
-    // [0.0, 1.0]
+    // (0.0, 1.0)
     inline static double probability() {
-        return xorshift() * INV_MAX;
+        return generator().probability();
     }
     
     inline static double get_double(double x, double y) {
@@ -55,17 +45,12 @@ class random {
     }
     
     inline static bool toss() {
-        return xorshift() & 1;
+        return generator().toss();
     }
     
-    private:
-    constexpr static double INV_MAX = 1.0 / 0xFFFFFFFF;
-    
-    inline static unsigned xorshift() {
-        static unsigned x = 123456789, y = 362436039, z = 521288629, w = 88675123;
-        unsigned t = x ^ (x << 11);
-        x = y, y = z, z = w;
-        return w = (w ^ (w >> 19)) ^ (t ^ (t >> 8));
+    // sa::random と同じ系列を使う (library/rng.h)。SEED 環境変数で系列を固定できる
+    static manarimo::rng& generator() {
+        return sa::random::generator();
     }
 };
 
@@ -77,62 +62,14 @@ const char* getenv_or(const char* varname, const char* fallback) {
 const double START_TEMP = atof(getenv_or("START_TEMP", "10000"));
 const double END_TEMP = atof(getenv_or("END_TEMP", "1e-9"));
 
-class simulated_annealing {
-    public:
-    simulated_annealing(double time_limit);
-    inline bool end();
-    inline bool accept(double current_score, double next_score);
-    void print() const;
-    
-    private:
-    constexpr static bool MAXIMIZE = true;
-    constexpr static int LOG_SIZE = 0xFFFF;
-    constexpr static int UPDATE_INTERVAL = 0xFF;
-    double time_limit;
-    double temp_ratio;
-    double log_probability[LOG_SIZE + 1];
-    long long iteration = 0;
-    long long accepted = 0;
-    long long rejected = 0;
-    double time = 0;
-    double temp = START_TEMP;
-    timer sa_timer;
-};
-
-simulated_annealing::simulated_annealing(double time_limit) : time_limit(time_limit) {
-    temp_ratio = (END_TEMP - START_TEMP) / time_limit;
-    sa_timer.start();
-    for (int i = 0; i <= LOG_SIZE; i++) log_probability[i] = log(random::probability());
-}
-
-inline bool simulated_annealing::end() {
-    iteration++;
-    if ((iteration & UPDATE_INTERVAL) == 0) {
-        time = sa_timer.get_time();
-        temp = START_TEMP + temp_ratio * time;
-        return time >= time_limit;
-    } else {
-        return false;
-    }
-}
-
-inline bool simulated_annealing::accept(double current_score, double next_score) {
-    double diff = (MAXIMIZE ? next_score - current_score : current_score - next_score);
-    if (diff >= 0 || diff > log_probability[random::get_fast(LOG_SIZE)] * temp) {
-        accepted++;
-        return true;
-    } else {
-        rejected++;
-        return false;
-    }
-}
-
-void simulated_annealing::print() const {
-    fprintf(stderr, "iteration: %lld\n", iteration);
-    fprintf(stderr, "accepted: %lld\n", accepted);
-    fprintf(stderr, "rejected: %lld\n", rejected);
+// START_TEMP から END_TEMP へ線形に冷やす。SA_* 環境変数で上書きできる (library/simulated_annealing.h)
+sa::schedule sa_schedule(double time_limit) {
+    return sa::schedule(time_limit, START_TEMP, END_TEMP).override_from_env();
 }
 
+// 2 以上なら、採用率が SPECULATIVE_THRESHOLD を下回ったところで移動の候補を SPECULATIVE_BATCH 個ずつ並列に評価する
+const int SPECULATIVE_BATCH = atoi(getenv_or("SPECULATIVE_BATCH", "0"));
+const double SPECULATIVE_THRESHOLD = atof(getenv_or("SPECULATIVE_THRESHOLD", "0.05"));
 const double INIT_TIME_LIMIT = atof(getenv_or("INIT_TIME_LIMIT", "10"));
 const double MAIN_TIME_LIMIT = atof(getenv_or("MAIN_TIME_LIMIT", "100"));
 const int MAX_MUSICIAN = 1500;
@@ -149,17 +86,30 @@ double stage_top;
 const double max_diff_width = atof(getenv_or("MAX_DIFF_DISTANCE", "1"));
 const double max_diff_height = atof(getenv_or("MAX_DIFF_DISTANCE", "1"));
 vector<geo::P> placements;
+// placements と同じ位置を持つ衝突判定用のグリッド
+manarimo::spatial_grid grid;
 vector<pair<double, int>> attendee_angles[MAX_MUSICIAN];
 vector<int> blocked_attendees[MAX_MUSICIAN][MAX_MUSICIAN];
 int blocked_count[MAX_MUSICIAN][MAX_ATTENDEE];
 double impact_sum[MAX_MUSICIAN];
-vector<pair<double, int>> tmp_attendee_angles;
-vector<int> tmp_blocked_attendees[MAX_MUSICIAN];
-int tmp_blocked_count[MAX_ATTENDEE];
-double tmp_impact_sum[MAX_MUSICIAN];
 vector<geo::P> best_placements;
 vector<double> volumes;
 
+// 演奏家 m を p に動かす候補と、その評価結果
+// 評価は今の状態を読むだけなので、同じ状態に対する複数の候補を別々のスレッドで評価できる
+struct move_candidate {
+    int m;
+    geo::P p;
+    double score;
+    vector<pair<double, int>> attendee_angles;
+    vector<int> blocked_attendees[MAX_MUSICIAN];
+    int blocked_count[MAX_ATTENDEE];
+    double impact_sum[MAX_MUSICIAN];
+    vector<pair<int, int>> new_blocked;
+    // 評価中に blocked_attendees[i][m] に入っている聴衆の印
+    bool unblocking[MAX_ATTENDEE] = {};
+};
+
 void input() {
     manarimo::load_problem(std::cin, problem);
     
@@ -172,6 +122,7 @@ void input() {
     stage_top = stage_bottom + problem.stage_height;
     stage_bottom += RADIUS;
     stage_top -= RADIUS;
+    grid.reset(stage_left, stage_bottom, stage_right - stage_left, stage_top - stage_bottom, RADIUS);
 }
 
 void output(const vector<geo::P>& placements, const vector<double>& volumes) {
@@ -188,18 +139,13 @@ double dist(const geo::P& p1, const geo::P& p2) {
 
 void random_init() {
     placements.clear();
+    grid.build(placements);
     for (int i = 0; i < problem.musicians.size(); i++) {
         while (true) {
             geo::P p(random::get(stage_left, stage_right), random::get(stage_bottom, stage_top));
-            bool ng = false;
-            for (int j = 0; j < i; j++) {
-                if (dist2(placements[j], p) < RADIUS2) {
-                    ng = true;
-                    break;
-                }
-            }
-            if (!ng) {
+            if (!grid.collides(p, RADIUS2)) {
                 placements.push_back(p);
+                grid.insert(i, p);
                 break;
             }
         }
@@ -268,11 +214,13 @@ double score_all() {
 }
 
 double score_one_no_block(const geo::P& p, int musician) {
-    double sum = 0;
-    for (const manarimo::atendee_t& a : problem.attendees) {
-        sum += calc_one_score(p, a.pos, a.tastes[musician]);
-    }
-    return sum;
+    return manarimo::no_block_impact(problem.attendee_x_data, problem.attendee_y_data, problem.attendees.size(), p.X, p.Y, problem.tastes_by_instrument[musician]);
+}
+
+// p にいる演奏家の楽器が musician1 だったときと musician2 だったときの score_one_no_block を out[0], out[1] に入れる
+void score_two_no_block(const geo::P& p, int musician1, int musician2, double* out) {
+    const double* tastes[2] = {problem.tastes_by_instrument[musician1], problem.tastes_by_instrument[musician2]};
+    manarimo::no_block_impacts<2>(problem.attendee_x_data, problem.attendee_y_data, problem.attendees.size(), p.X, p.Y, tastes, out);
 }
 
 double score_all_no_block() {
@@ -281,12 +229,90 @@ double score_all_no_block() {
     return sum;
 }
 
+// 演奏家をランダムに選んで少し動かす候補を作る。他の演奏家とぶつかるなら false
+bool draw_move(move_candidate& c) {
+    int m = random::get(problem.musicians.size());
+    const geo::P& current_p = placements[m];
+    double dx = clamp(random::get_double(-max_diff_width, max_diff_width), stage_left - current_p.X, stage_right - current_p.X);
+    double dy = clamp(random::get_double(-max_diff_height, max_diff_height), stage_bottom - current_p.Y, stage_top - current_p.Y);
+    geo::P next_p = current_p;
+    next_p.X += dx;
+    next_p.Y += dy;
+    if (grid.collides(next_p, RADIUS2, m)) return false;
+    c.m = m;
+    c.p = next_p;
+    return true;
+}
+
+// c.m を c.p に動かしたときのスコアを c に求める。今の状態は書き換えない
+void evaluate_move(move_candidate& c) {
+    const int m = c.m;
+    const geo::P& next_p = c.p;
+    for (int i = 0; i < problem.musicians.size(); i++) c.impact_sum[i] = impact_sum[i];
+    calc_blocked_one(m, next_p, c.attendee_angles, c.blocked_attendees, c.blocked_count);
+    c.impact_sum[m] = 0;
+    for (int i = 0; i < problem.attendees.size(); i++) {
+        if (c.blocked_count[i] == 0) c.impact_sum[m] += calc_one_score(next_p, problem.attendees[i].pos, problem.attendees[i].tastes[problem.musicians[m]]);
+    }
+    c.new_blocked.clear();
+    for (int i = 0; i < problem.musicians.size(); i++) {
+        if (i == m) continue;
+        // m が抜けて見えるようになる聴衆 (blocked_count が m の分だけ減る)
+        for (int j : blocked_attendees[i][m]) {
+            c.unblocking[j] = true;
+            if (blocked_count[i][j] == 1) c.impact_sum[i] += calc_one_score(placements[i], problem.attendees[j].pos, problem.attendees[j].tastes[problem.musicians[i]]);
+        }
+        double angle = get_angle(placements[i], next_p);
+        double offset = asin(BLOCK_RADIUS / dist(placements[i], next_p));
+        double start = angle - offset;
+        double end = angle + offset;
+        if (start < -M_PI) {
+            start += M_PI * 2;
+            end += M_PI * 2;
+        }
+        int index = lower_bound(attendee_angles[i].begin(), attendee_angles[i].end(), make_pair(start, 100000000)) - attendee_angles[i].begin();
+        for (; index < attendee_angles[i].size(); index++) {
+            if (attendee_angles[i][index].first >= end) break;
+            int attendee = attendee_angles[i][index].second;
+            c.new_blocked.emplace_back(i, attendee);
+            if (blocked_count[i][attendee] - c.unblocking[attendee] == 0) c.impact_sum[i] -= calc_one_score(placements[i], problem.attendees[attendee].pos, problem.attendees[attendee].tastes[problem.musicians[i]]);
+        }
+        for (int j : blocked_attendees[i][m]) c.unblocking[j] = false;
+    }
+    double next_score = 0;
+    for (int i = 0; i < problem.musicians.size(); i++) {
+        next_score += ceil(VOLUME * max(c.impact_sum[i], 0.0));
+    }
+    c.score = next_score;
+}
+
+// evaluate_move した候補を今の状態に反映する。c の作業領域は入れ替えで使い回す
+void commit_move(move_candidate& c) {
+    const int m = c.m;
+    placements[m] = c.p;
+    grid.move(m, c.p);
+    swap(attendee_angles[m], c.attendee_angles);
+    for (int i = 0; i < problem.musicians.size(); i++) swap(blocked_attendees[m][i], c.blocked_attendees[i]);
+    for (int i = 0; i < problem.attendees.size(); i++) blocked_count[m][i] = c.blocked_count[i];
+    for (int i = 0; i < problem.musicians.size(); i++) {
+        if (i == m) continue;
+        for (int j : blocked_attendees[i][m]) blocked_count[i][j]--;
+        blocked_attendees[i][m].clear();
+    }
+    for (const pair<int, int>& p : c.new_blocked) {
+        blocked_attendees[p.first][m].push_back(p.second);
+        blocked_count[p.first][p.second]++;
+    }
+    for (int i = 0; i < problem.musicians.size(); i++) impact_sum[i] = c.impact_sum[i];
+}
+
 void save_best_state() {
     best_placements = placements;
 }
 
 void load_best_state() {
     placements = best_placements;
+    grid.build(placements);
     score_all();
 }
 
@@ -301,15 +327,17 @@ void sa_no_block() {
         }
     }
     placements = best_placements;
+    grid.build(placements);
     double current_score = best_score;
     
     int unchanged = 0;
-    simulated_annealing sa(INIT_TIME_LIMIT);
+    sa::simulated_annealing sa(sa_schedule(INIT_TIME_LIMIT));
     while (!sa.end()) {
         unchanged++;
         if (unchanged == 10000) {
             current_score = best_score;
             placements = best_placements;
+            grid.build(placements);
             unchanged = 0;
         }
         
@@ -321,21 +349,14 @@ void sa_no_block() {
             geo::P next_p = current_p;
             next_p.X += dx;
             next_p.Y += dy;
-            bool ng = false;
-            for (int i = 0; i < placements.size(); i++) {
-                if (i == m) continue;
-                if (dist2(placements[i], next_p) < RADIUS2) {
-                    ng = true;
-                    break;
-                }
-            }
-            if (ng) continue;
+            if (grid.collides(next_p, RADIUS2, m)) continue;
             double next_score = current_score;
             next_score -= score_one_no_block(current_p, problem.musicians[m]);
             next_score += score_one_no_block(next_p, problem.musicians[m]);
             if (sa.accept(current_score, next_score)) {
                 current_score = next_score;
                 placements[m] = next_p;
+                grid.move(m, next_p);
                 if (current_score > best_score) {
                     best_score = current_score;
                     best_placements = placements;
@@ -347,13 +368,17 @@ void sa_no_block() {
             int m2 = random::get(problem.musicians.size() - 1);
             if (m2 >= m1) m2++;
             double next_score = current_score;
-            next_score -= score_one_no_block(placements[m1], problem.musicians[m1]);
-            next_score -= score_one_no_block(placements[m2], problem.musicians[m2]);
-            next_score += score_one_no_block(placements[m1], problem.musicians[m2]);
-            next_score += score_one_no_block(placements[m2], problem.musicians[m1]);
+            double impact1[2], impact2[2];
+            score_two_no_block(placements[m1], problem.musicians[m1], problem.musicians[m2], impact1);
+            score_two_no_block(placements[m2], problem.musicians[m2], problem.musicians[m1], impact2);
+            next_score -= impact1[0];
+            next_score -= impact2[0];
+            next_score += impact1[1];
+            next_score += impact2[1];
             if (sa.accept(current_score, next_score)) {
                 current_score = next_score;
                 swap(placements[m1], placements[m2]);
+                grid.swap_positions(m1, m2);
                 if (current_score > best_score) {
                     best_score = current_score;
                     best_placements = placements;
@@ -370,18 +395,25 @@ int main(int argc, char *argv[]) {
     if (argc < 2) {
         sa_no_block();
         placements = best_placements;
+        grid.build(placements);
     } else {
         manarimo::solution_t intermediate_solution;
         manarimo::load_solution(string(argv[1]), intermediate_solution);
         best_placements = intermediate_solution.as_p();
         placements = best_placements;
+        grid.build(placements);
     }
     double best_score = score_all();
     double current_score = best_score;
     
     int unchanged = 0;
-    vector<pair<int, int>> new_blocked;
-    simulated_annealing sa(MAIN_TIME_LIMIT);
+    // 候補数はスレッド数を超えないようにする (1コアなら候補を増やしても遅くなるだけ)
+    manarimo::worker_pool pool(min(max(1, SPECULATIVE_BATCH), (int) max(1u, thread::hardware_concurrency())));
+    const bool speculative = pool.size() > 1;
+    vector<move_candidate> candidates(pool.size());
+    // 移動の採用率の指数移動平均
+    double move_acceptance = 1;
+    sa::simulated_annealing sa(sa_schedule(MAIN_TIME_LIMIT));
     while (!sa.end()) {
         unchanged++;
         if (unchanged == 10000) {
@@ -391,83 +423,28 @@ int main(int argc, char *argv[]) {
         }
         
         if (random::get(100) < 80) {
-            int m = random::get(problem.musicians.size());
-            geo::P& current_p = placements[m];
-            double dx = clamp(random::get_double(-max_diff_width, max_diff_width), stage_left - current_p.X, stage_right - current_p.X);
-            double dy = clamp(random::get_double(-max_diff_height, max_diff_height), stage_bottom - current_p.Y, stage_top - current_p.Y);
-            geo::P next_p = current_p;
-            next_p.X += dx;
-            next_p.Y += dy;
-            bool ng = false;
-            for (int i = 0; i < placements.size(); i++) {
-                if (i == m) continue;
-                if (dist2(placements[i], next_p) < RADIUS2) {
-                    ng = true;
-                    break;
-                }
-            }
-            if (ng) continue;
-            for (int i = 0; i < problem.musicians.size(); i++) tmp_impact_sum[i] = impact_sum[i];
-            for (int i = 0; i < problem.musicians.size(); i++) {
-                if (i == m) continue;
-                for (int j : blocked_attendees[i][m]) {
-                    blocked_count[i][j]--;
-                    if (blocked_count[i][j] == 0) tmp_impact_sum[i] += calc_one_score(placements[i], problem.attendees[j].pos, problem.attendees[j].tastes[problem.musicians[i]]);
-                }
-            }
-            calc_blocked_one(m, next_p, tmp_attendee_angles, tmp_blocked_attendees, tmp_blocked_count);
-            tmp_impact_sum[m] = 0;
-            for (int i = 0; i < problem.attendees.size(); i++) {
-                if (tmp_blocked_count[i] == 0) tmp_impact_sum[m] += calc_one_score(next_p, problem.attendees[i].pos, problem.attendees[i].tastes[problem.musicians[m]]);
-            }
-            new_blocked.clear();
-            for (int i = 0; i < problem.musicians.size(); i++) {
-                if (i == m) continue;
-                double angle = get_angle(placements[i], next_p);
-                double offset = asin(BLOCK_RADIUS / dist(placements[i], next_p));
-                double start = angle - offset;
-                double end = angle + offset;
-                if (start < -M_PI) {
-                    start += M_PI * 2;
-                    end += M_PI * 2;
-                }
-                int index = lower_bound(attendee_angles[i].begin(), attendee_angles[i].end(), make_pair(start, 100000000)) - attendee_angles[i].begin();
-                for (; index < attendee_angles[i].size(); index++) {
-                    if (attendee_angles[i][index].first >= end) break;
-                    int attendee = attendee_angles[i][index].second;
-                    new_blocked.emplace_back(i, attendee);
-                    if (blocked_count[i][attendee] == 0) tmp_impact_sum[i] -= calc_one_score(placements[i], problem.attendees[attendee].pos, problem.attendees[attendee].tastes[problem.musicians[i]]);
-                }
+            // 採用率が低くなったら候補を batch 個作って並列に評価し、前から順に採否を決める
+            // 最初に採用された候補だけを反映し、残りは反映前の状態に対する評価なので捨てる
+            const int batch = (speculative && move_acceptance < SPECULATIVE_THRESHOLD) ? pool.size() : 1;
+            int n_candidate = 0;
+            for (int k = 0; k < batch; k++) {
+                if (draw_move(candidates[n_candidate])) n_candidate++;
             }
-            double next_score = 0;
-            for (int i = 0; i < problem.musicians.size(); i++) {
-                next_score += ceil(VOLUME * max(tmp_impact_sum[i], 0.0));
-            }
-            if (sa.accept(current_score, next_score)) {
-                current_score = next_score;
-                placements[m] = next_p;
-                swap(attendee_angles[m], tmp_attendee_angles);
-                for (int i = 0; i < problem.musicians.size(); i++) swap(blocked_attendees[m][i], tmp_blocked_attendees[i]);
-                for (int i = 0; i < problem.attendees.size(); i++) blocked_count[m][i] = tmp_blocked_count[i];
-                for (int i = 0; i < problem.musicians.size(); i++) {
-                    if (i == m) continue;
-                    blocked_attendees[i][m].clear();
-                }
-                for (const pair<int, int>& p : new_blocked) {
-                    blocked_attendees[p.first][m].push_back(p.second);
-                    blocked_count[p.first][p.second]++;
-                }
-                for (int i = 0; i < problem.musicians.size(); i++) impact_sum[i] = tmp_impact_sum[i];
+            if (n_candidate == 0) continue;
+            pool.run(n_candidate, [&](int k, int) { evaluate_move(candidates[k]); });
+            for (int k = 0; k < n_candidate; k++) {
+                move_candidate& c = candidates[k];
+                const bool accepted = sa.accept(current_score, c.score);
+                move_acceptance = move_acceptance * 0.999 + (accepted ? 0.001 : 0);
+                if (!accepted) continue;
+                current_score = c.score;
+                commit_move(c);
                 if (current_score > best_score) {
                     best_score = current_score;
                     save_best_state();
                     unchanged = 0;
                 }
-            } else {
-                for (int i = 0; i < problem.musicians.size(); i++) {
-                    if (i == m) continue;
-                    for (int j : blocked_attendees[i][m]) blocked_count[i][j]++;
-                }
+                break;
             }
         } else {
             int m1 = random::get(problem.musicians.size());
@@ -487,6 +464,7 @@ int main(int argc, char *argv[]) {
             if (sa.accept(current_score, next_score)) {
                 current_score = next_score;
                 swap(placements[m1], placements[m2]);
+                grid.swap_positions(m1, m2);
                 attendee_angles[m1].swap(attendee_angles[m2]);
                 for (int i = 0; i < problem.musicians.size(); i++) {
                     if (i == m1 || i == m2) continue;
@@ -507,6 +485,7 @@ int main(int argc, char *argv[]) {
     }
     
     placements = best_placements;
+    grid.build(placements);
     best_score = score_all();
     
     output(best_placements, volumes);
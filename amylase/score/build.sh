@@ -1,3 +1,3 @@
 #!/bin/bash
 
-g++ -O3 -std=c++17 -I../../library main.cpp
\ No newline at end of file
+g++ -O3 -std=c++17 -pthread -I../../library main.cpp
\ No newline at end of file
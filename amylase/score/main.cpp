@@ -7,7 +7,7 @@
 
 using namespace std;
 
-// c++ -std=c++20 -O3 -I../../library main.cpp
+// c++ -std=c++20 -O3 -pthread -I../../library main.cpp
 int main(int argc, char *argv[]) {
     if (argc < 3) {
         cout << argv[0] << " problem solution [--skip-validate]" << endl;
@@ -25,6 +25,6 @@ int main(int argc, char *argv[]) {
             return 0;
         }
     }
-    cout << manarimo::score(prob, sol) << endl;
+    cout << manarimo::score_parallel(prob, sol, thread::hardware_concurrency()) << endl;
     return 0;
 }
\ No newline at end of file
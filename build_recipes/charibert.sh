@@ -2,5 +2,5 @@
 
 CWD=`pwd`
 cd ../amylase/charibert
-g++ -O3 -std=c++17 main.cpp
+g++ -O3 -std=c++17 -pthread main.cpp
 cp a.out $CWD
\ No newline at end of file
@@ -0,0 +1,6 @@
+#!/bin/bash
+
+CWD=`pwd`
+cd ../library
+g++ -O3 -std=c++17 convert_problem.cpp
+cp a.out $CWD
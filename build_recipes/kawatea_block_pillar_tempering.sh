@@ -0,0 +1,6 @@
+#!/bin/bash
+
+CWD=`pwd`
+cd ../kawatea
+g++ -O3 -std=c++17 -pthread block_pillar_tempering.cpp
+cp a.out $CWD
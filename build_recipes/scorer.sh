@@ -2,5 +2,5 @@
 
 CWD=`pwd`
 cd ../amylase/score
-g++ -O3 -std=c++17 -I../../library main.cpp
+g++ -O3 -std=c++17 -pthread -I../../library main.cpp
 cp a.out $CWD
\ No newline at end of file
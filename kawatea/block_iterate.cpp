@@ -11,6 +11,7 @@
 #endif
 #include "../library/scoring.h"
 #include "../library/solution.h"
+#include "../library/rng.h"
 
 using namespace std;
 
@@ -32,7 +33,7 @@ class random {
     public:
     // [0, x)
     inline static unsigned get(unsigned x) {
-        return ((unsigned long long)xorshift() * x) >> 32;
+        return generator().get(x);
     }
     
     // [x, y]
@@ -42,12 +43,12 @@ class random {
     
     // [0, x] (x = 2^c - 1)
     inline static unsigned get_fast(unsigned x) {
-        return xorshift() & x;
+        return generator().get_fast(x);
     }
     
-    // [0.0, 1.0]
+    // (0.0, 1.0)
     inline static double probability() {
-        return xorshift() * INV_MAX;
+        return generator().probability();
     }
     
     inline static double get_double(double x, double y) {
@@ -55,17 +56,13 @@ class random {
     }
     
     inline static bool toss() {
-        return xorshift() & 1;
+        return generator().toss();
     }
     
-    private:
-    constexpr static double INV_MAX = 1.0 / 0xFFFFFFFF;
-    
-    inline static unsigned xorshift() {
-        static unsigned x = 123456789, y = 362436039, z = 521288629, w = 88675123;
-        unsigned t = x ^ (x << 11);
-        x = y, y = z, z = w;
-        return w = (w ^ (w >> 19)) ^ (t ^ (t >> 8));
+    // スレッドごとに持つ xoshiro256** (library/rng.h)。SEED 環境変数で系列を固定できる
+    static manarimo::rng& generator() {
+        static thread_local manarimo::rng instance(manarimo::seed_from_env());
+        return instance;
     }
 };
 
@@ -169,9 +166,6 @@ vector<geo::P> best_placements;
 vector<double> volumes;
 
 void input() {
-    int seed = chrono::system_clock::to_time_t(chrono::system_clock::now()) % 1000;
-    for (int i = 0; i < seed; i++) random::toss();
-    
     manarimo::load_problem(std::cin, problem);
     
     stage_left = problem.stage_bottom_left.X;
@@ -9,35 +9,22 @@
 #endif
 #include "../library/scoring.h"
 #include "../library/solution.h"
+#include "../library/rng.h"
+#include "../library/simulated_annealing.h"
+#include "../library/blocked_lists.h"
+#include "../library/angular_index.h"
+#include "../library/spatial_grid.h"
+#include "../library/impact_kernels.h"
+#include "../library/attendee_pruning.h"
+#include "../library/attendee_lod.h"
 
 using namespace std;
 
-class timer {
-    public:
-    void start() {
-        origin = rdtsc();
-    }
-    
-    inline double get_time() {
-        return (rdtsc() - origin) * SECONDS_PER_CLOCK;
-    }
-    
-    private:
-    constexpr static double SECONDS_PER_CLOCK = 1 / 3.0e9;
-    unsigned long long origin;
-    
-    inline static unsigned long long rdtsc() {
-        unsigned long long lo, hi;
-        __asm__ volatile ("rdtsc" : "=a" (lo), "=d" (hi));
-        return (hi << 32) | lo;
-    }
-};
-
 class random {
     public:
     // [0, x)
     inline static unsigned get(unsigned x) {
-        return ((unsigned long long)xorshift() * x) >> 32;
+        return generator().get(x);
     }
     
     // [x, y]
@@ -47,12 +34,12 @@ class random {
     
     // [0, x] (x = 2^c - 1)
     inline static unsigned get_fast(unsigned x) {
-        return xorshift() & x;
+        return generator().get_fast(x);
     }
     
-    // [0.0, 1.0]
+    // (0.0, 1.0)
     inline static double probability() {
-        return xorshift() * INV_MAX;
+        return generator().probability();
     }
     
     inline static double get_double(double x, double y) {
@@ -60,110 +47,69 @@ class random {
     }
     
     inline static bool toss() {
-        return xorshift() & 1;
+        return generator().toss();
     }
     
-    private:
-    constexpr static double INV_MAX = 1.0 / 0xFFFFFFFF;
-    
-    inline static unsigned xorshift() {
-        static unsigned x = 123456789, y = 362436039, z = 521288629, w = 88675123;
-        unsigned t = x ^ (x << 11);
-        x = y, y = z, z = w;
-        return w = (w ^ (w >> 19)) ^ (t ^ (t >> 8));
+    // sa::random と同じ系列を使う (library/rng.h)。SEED 環境変数で系列を固定できる
+    static manarimo::rng& generator() {
+        return sa::random::generator();
     }
 };
 
-class simulated_annealing {
-    public:
-    simulated_annealing(double time_limit);
-    inline bool end();
-    inline bool accept(double current_score, double next_score);
-    void print() const;
-    
-    private:
-    constexpr static bool MAXIMIZE = true;
-    constexpr static int LOG_SIZE = 0xFFFF;
-    constexpr static int UPDATE_INTERVAL = 0xFF;
-    constexpr static double START_TEMP = 10000;
-    constexpr static double END_TEMP = 1e-9;
-    double time_limit;
-    double temp_ratio;
-    double log_probability[LOG_SIZE + 1];
-    long long iteration = 0;
-    long long accepted = 0;
-    long long rejected = 0;
-    double time = 0;
-    double temp = START_TEMP;
-    timer sa_timer;
-};
-
-simulated_annealing::simulated_annealing(double time_limit) : time_limit(time_limit) {
-    temp_ratio = (END_TEMP - START_TEMP) / time_limit;
-    sa_timer.start();
-    for (int i = 0; i <= LOG_SIZE; i++) log_probability[i] = log(random::probability());
-}
+const double START_TEMP = 10000;
+const double END_TEMP = 1e-9;
 
-inline bool simulated_annealing::end() {
-    iteration++;
-    if ((iteration & UPDATE_INTERVAL) == 0) {
-        time = sa_timer.get_time();
-        temp = START_TEMP + temp_ratio * time;
-        return time >= time_limit;
-    } else {
-        return false;
-    }
-}
-
-inline bool simulated_annealing::accept(double current_score, double next_score) {
-    double diff = (MAXIMIZE ? next_score - current_score : current_score - next_score);
-    if (diff >= 0 || diff > log_probability[random::get_fast(LOG_SIZE)] * temp) {
-        accepted++;
-        return true;
-    } else {
-        rejected++;
-        return false;
-    }
-}
-
-void simulated_annealing::print() const {
-    fprintf(stderr, "iteration: %lld\n", iteration);
-    fprintf(stderr, "accepted: %lld\n", accepted);
-    fprintf(stderr, "rejected: %lld\n", rejected);
+// START_TEMP から END_TEMP へ線形に冷やす。SA_* 環境変数で上書きできる (library/simulated_annealing.h)
+sa::schedule sa_schedule(double time_limit) {
+    return sa::schedule(time_limit, START_TEMP, END_TEMP).override_from_env();
 }
 
 const double INIT_TIME_LIMIT = 10;
 const double MAIN_TIME_LIMIT = 250;
-const int MAX_MUSICIAN = 1000;
-const int MAX_ATTENDEE = 700;
 const double RADIUS = 10;
 const double RADIUS2 = RADIUS * RADIUS;
 const double BLOCK_RADIUS = 5;
 const double VOLUME = 10;
 manarimo::problem_t problem;
+// LOD で近似しているときの元の問題
+bool use_lod = false;
+manarimo::problem_t exact_problem;
+// LOD で近似しているときに、最後に元の問題で比べ直す配置 (近似の得点で最良を更新した最近の配置)
+const int LOD_CANDIDATES = 8;
+vector<vector<geo::P>> best_candidates;
 double stage_left;
 double stage_right;
 double stage_bottom;
 double stage_top;
 double max_diff_width;
 double max_diff_height;
-vector<int> instrument[MAX_MUSICIAN];
+vector<vector<int>> instrument;
 vector<geo::P> placements;
-vector<pair<double, int>> attendee_angles[MAX_MUSICIAN];
-vector<int> blocked_attendees[MAX_MUSICIAN][MAX_MUSICIAN];
-int blocked_count[MAX_MUSICIAN][MAX_ATTENDEE];
-double q[MAX_MUSICIAN];
-double impact_sum[MAX_MUSICIAN];
-vector<pair<double, int>> tmp_attendee_angles;
-vector<int> tmp_blocked_attendees[MAX_MUSICIAN];
-int tmp_blocked_count[MAX_ATTENDEE];
-double tmp_q[MAX_MUSICIAN];
-double tmp_impact_sum[MAX_MUSICIAN];
+// placements と同じ位置を持つ衝突判定用のグリッド
+manarimo::spatial_grid grid;
+// ステージの区画ごとに、遮蔽に関わりうる柱
+manarimo::pillar_index pillars;
+vector<manarimo::angular_index> attendee_angles;
+vector<manarimo::blocked_row> blocked_attendees;
+vector<vector<int>> blocked_count;
+vector<double> q;
+vector<double> impact_sum;
+manarimo::angular_index tmp_attendee_angles;
+manarimo::blocked_row tmp_blocked_attendees;
+vector<int> tmp_blocked_count;
+vector<double> tmp_q;
+vector<double> tmp_impact_sum;
 vector<geo::P> best_placements;
 vector<double> volumes;
+// attendee_order[in]: 楽器 in の演奏家への寄与の大きさの上界が大きい順に並べた聴衆
+// gain_bound[in][k]: 楽器 in の演奏家がステージのどこにいても、attendee_order[in][k] 以降から得られる正の寄与の合計を超えない値
+vector<vector<int>> attendee_order;
+vector<vector<double>> gain_bound;
+vector<double> tmp_contribution;
 
-void input() {
-    manarimo::load_problem(std::cin, problem);
+// problem に合わせて状態を作り直す
+void setup() {
+    pillars.build(problem);
     
     stage_left = problem.stage_bottom_left.X;
     stage_right = stage_left + problem.stage_width;
@@ -175,9 +121,60 @@ void input() {
     stage_top = stage_bottom + problem.stage_height;
     stage_bottom += RADIUS;
     stage_top -= RADIUS;
+    grid.reset(stage_left, stage_bottom, stage_right - stage_left, stage_top - stage_bottom, RADIUS);
     max_diff_height = (stage_top - stage_bottom) / 10;
     
-    for (int i = 0; i < problem.musicians.size(); i++) instrument[problem.musicians[i]].push_back(i);
+    // 状態は問題の大きさに合わせて確保する
+    const int n_musician = problem.musicians.size();
+    const int n_attendee = problem.attendees.size();
+    instrument.assign(problem.n_instruments, vector<int>());
+    for (int i = 0; i < n_musician; i++) instrument[problem.musicians[i]].push_back(i);
+    attendee_angles.assign(n_musician, manarimo::angular_index());
+    for (manarimo::angular_index& index : attendee_angles) index.init(problem.attendee_x_data, problem.attendee_y_data, n_attendee);
+    tmp_attendee_angles.init(problem.attendee_x_data, problem.attendee_y_data, n_attendee);
+    blocked_attendees.assign(n_musician, manarimo::blocked_row(n_musician));
+    blocked_count.assign(n_musician, vector<int>(n_attendee));
+    q.assign(n_musician, 0);
+    impact_sum.assign(n_musician, 0);
+    tmp_blocked_attendees.reset(n_musician);
+    tmp_blocked_count.assign(n_attendee, 0);
+    tmp_q.assign(n_musician, 0);
+    tmp_impact_sum.assign(n_musician, 0);
+    
+    // 演奏家は [stage_left, stage_right] x [stage_bottom, stage_top] の中にいるので、聴衆までの距離はこの長方形までの距離以上
+    vector<double> min_dist2(n_attendee);
+    for (int j = 0; j < n_attendee; j++) {
+        double dx = max({stage_left - problem.attendee_x_data[j], problem.attendee_x_data[j] - stage_right, 0.0});
+        double dy = max({stage_bottom - problem.attendee_y_data[j], problem.attendee_y_data[j] - stage_top, 0.0});
+        min_dist2[j] = max(dx * dx + dy * dy, RADIUS2);
+    }
+    attendee_order.assign(problem.n_instruments, vector<int>(n_attendee));
+    gain_bound.assign(problem.n_instruments, vector<double>(n_attendee + 1, 0));
+    for (int in = 0; in < problem.n_instruments; in++) {
+        const double* tastes = problem.tastes_by_instrument[in];
+        vector<int>& order = attendee_order[in];
+        for (int j = 0; j < n_attendee; j++) order[j] = j;
+        sort(order.begin(), order.end(), [&](int a, int b) { return fabs(tastes[a]) / min_dist2[a] > fabs(tastes[b]) / min_dist2[b]; });
+        for (int k = n_attendee - 1; k >= 0; k--) {
+            gain_bound[in][k] = gain_bound[in][k + 1] + ceil(1000000 * max(tastes[order[k]], 0.0) / min_dist2[order[k]]);
+        }
+    }
+    tmp_contribution.assign(n_attendee, 0);
+}
+
+void input() {
+    // 得点に関係しない聴衆を除いておく (PRUNE_EPSILON が 0 なら得点は変わらない)
+    const manarimo::attendee_map pruned = manarimo::load_pruned_problem(std::cin, problem);
+    fprintf(stderr, "pruned attendees : %d hidden, %d negligible, %d left\n", pruned.n_hidden, pruned.n_negligible, (int) pruned.original_ids.size());
+    // LOD_TOLERANCE > 0 なら遠くの聴衆をまとめた問題で焼きなまし、最後に exact_problem で計算し直す
+    const double tolerance = manarimo::lod_tolerance_from_env();
+    if (tolerance > 0) {
+        use_lod = true;
+        exact_problem = problem;
+        const manarimo::attendee_lod lod = manarimo::build_attendee_lod(exact_problem, problem, tolerance);
+        fprintf(stderr, "lod attendees : %d -> %d, impact error <= %lf\n", lod.n_original, problem.n_attendees(), *max_element(lod.impact_error.begin(), lod.impact_error.end()));
+    }
+    setup();
 }
 
 void output(const vector<geo::P>& placements, const vector<double>& volumes) {
@@ -194,81 +191,53 @@ double dist(const geo::P& p1, const geo::P& p2) {
 
 void random_init() {
     placements.clear();
+    grid.build(placements);
     for (int i = 0; i < problem.musicians.size(); i++) {
         while (true) {
             geo::P p(random::get(stage_left, stage_right), random::get(stage_bottom, stage_top));
-            bool ng = false;
-            for (int j = 0; j < i; j++) {
-                if (dist2(placements[j], p) < RADIUS2) {
-                    ng = true;
-                    break;
-                }
-            }
-            if (!ng) {
+            if (!grid.collides(p, RADIUS2)) {
                 placements.push_back(p);
+                grid.insert(i, p);
                 break;
             }
         }
     }
 }
 
-double get_angle(const geo::P& p1, const geo::P& p2) {
-    return atan2(p2.Y - p1.Y, p2.X - p1.X);
-}
-
-void calc_blocked_one(int musician, const geo::P& p, vector<pair<double, int>>& attendee_angles, vector<int>* blocked_attendees, int* blocked_count) {
-    attendee_angles.clear();
-    for (int i = 0; i < problem.attendees.size(); i++) {
-        double angle = get_angle(p, problem.attendees[i].pos);
-        attendee_angles.emplace_back(angle, i);
-        attendee_angles.emplace_back(angle + M_PI * 2, i);
-    }
-    sort(attendee_angles.begin(), attendee_angles.end());
+// previous は p の近くから見た並び (あれば並べ直しが速くなる)
+void calc_blocked_one(int musician, const geo::P& p, manarimo::angular_index& attendee_angles, const manarimo::angular_index& previous, manarimo::blocked_row& blocked_attendees, int* blocked_count) {
+    attendee_angles.build_from(previous, p.X, p.Y);
     
-    for (int i = 0; i < problem.musicians.size(); i++) blocked_attendees[i].clear();
+    blocked_attendees.clear();
     for (int i = 0; i < problem.attendees.size(); i++) blocked_count[i] = 0;
-    for (int i = 0; i < problem.musicians.size(); i++) {
-        if (i == musician) continue;
-        double angle = get_angle(p, placements[i]);
-        double offset = asin(BLOCK_RADIUS / dist(p, placements[i]));
-        double start = angle - offset;
-        double end = angle + offset;
-        if (start < -M_PI) {
-            start += M_PI * 2;
-            end += M_PI * 2;
-        }
-        int index = lower_bound(attendee_angles.begin(), attendee_angles.end(), make_pair(start, 100000000)) - attendee_angles.begin();
-        for (; index < attendee_angles.size(); index++) {
-            if (attendee_angles[index].first >= end) break;
-            blocked_attendees[i].push_back(attendee_angles[index].second);
-            blocked_count[attendee_angles[index].second]++;
-        }
-    }
-    for (int i = 0; i < problem.pillars.size(); i++) {
-        double angle = get_angle(p, problem.pillars[i].center);
-        double offset = asin(problem.pillars[i].radius / dist(p, problem.pillars[i].center));
-        double start = angle - offset;
-        double end = angle + offset;
-        if (start < -M_PI) {
-            start += M_PI * 2;
-            end += M_PI * 2;
-        }
-        int index = lower_bound(attendee_angles.begin(), attendee_angles.end(), make_pair(start, 100000000)) - attendee_angles.begin();
-        for (; index < attendee_angles.size(); index++) {
-            if (attendee_angles[index].first >= end) break;
-            if (geo::get_ratio(p, problem.attendees[attendee_angles[index].second].pos, problem.pillars[i].center) < 1) blocked_count[attendee_angles[index].second]++;
-        }
+    attendee_angles.for_each_blocked(placements.data(), placements.size(), BLOCK_RADIUS, [&](int i, int attendee) {
+        if (i == musician) return;
+        blocked_attendees.push_back(i, attendee);
+        blocked_count[attendee]++;
+    });
+    for (int i : pillars.near(p)) {
+        const geo::P& center = problem.pillars[i].center;
+        attendee_angles.for_each_blocked(center.X - p.X, center.Y - p.Y, problem.pillars[i].radius, [&](int attendee) {
+            if (geo::get_ratio(p, problem.attendees[attendee].pos, center) < 1) blocked_count[attendee]++;
+        });
     }
 }
 
 void calc_blocked() {
-    for (int i = 0; i < problem.musicians.size(); i++) calc_blocked_one(i, placements[i], attendee_angles[i], blocked_attendees[i], blocked_count[i]);
+    for (int i = 0; i < problem.musicians.size(); i++) calc_blocked_one(i, placements[i], attendee_angles[i], attendee_angles[i], blocked_attendees[i], blocked_count[i].data());
 }
 
 double calc_one_score(const geo::P& p1, const geo::P& p2, double taste) {
     return ceil(1000000 * taste / dist2(p1, p2));
 }
 
+// tastes は problem.tastes_by_instrument の1行
+double calc_one_score(const geo::P& p, int attendee, const double* tastes) {
+    double dx = p.X - problem.attendee_x_data[attendee];
+    double dy = p.Y - problem.attendee_y_data[attendee];
+    return ceil(1000000 * tastes[attendee] / (dx * dx + dy * dy));
+}
+
 double score_all_approximate() {
     calc_blocked();
     double sum = 0;
@@ -279,8 +248,9 @@ double score_all_approximate() {
             q[i] += 1 / dist(placements[i], placements[j]);
         }
         impact_sum[i] = 0;
+        const double* tastes = problem.tastes_by_instrument[problem.musicians[i]];
         for (int j = 0; j < problem.attendees.size(); j++) {
-            if (blocked_count[i][j] == 0) impact_sum[i] += calc_one_score(placements[i], problem.attendees[j].pos, problem.attendees[j].tastes[problem.musicians[i]]);
+            if (blocked_count[i][j] == 0) impact_sum[i] += calc_one_score(placements[i], j, tastes);
         }
         sum += ceil(VOLUME * q[i] * max(impact_sum[i], 0.0));
     }
@@ -298,8 +268,9 @@ double score_all_exact() {
             q += 1 / dist(placements[i], placements[j]);
         }
         double tmp = 0;
+        const double* tastes = problem.tastes_by_instrument[problem.musicians[i]];
         for (int j = 0; j < problem.attendees.size(); j++) {
-            if (blocked_count[i][j] == 0) tmp += ceil(VOLUME * q * calc_one_score(placements[i], problem.attendees[j].pos, problem.attendees[j].tastes[problem.musicians[i]]));
+            if (blocked_count[i][j] == 0) tmp += ceil(VOLUME * q * calc_one_score(placements[i], j, tastes));
         }
         if (tmp >= 0) {
             sum += tmp;
@@ -312,11 +283,13 @@ double score_all_exact() {
 }
 
 double score_one_no_block(const geo::P& p, int musician) {
-    double sum = 0;
-    for (const manarimo::atendee_t& a : problem.attendees) {
-        sum += calc_one_score(p, a.pos, a.tastes[musician]);
-    }
-    return sum;
+    return manarimo::no_block_impact(problem.attendee_x_data, problem.attendee_y_data, problem.attendees.size(), p.X, p.Y, problem.tastes_by_instrument[musician]);
+}
+
+// p にいる演奏家の楽器が musician1 だったときと musician2 だったときの score_one_no_block を out[0], out[1] に入れる
+void score_two_no_block(const geo::P& p, int musician1, int musician2, double* out) {
+    const double* tastes[2] = {problem.tastes_by_instrument[musician1], problem.tastes_by_instrument[musician2]};
+    manarimo::no_block_impacts<2>(problem.attendee_x_data, problem.attendee_y_data, problem.attendees.size(), p.X, p.Y, tastes, out);
 }
 
 double score_all_no_block() {
@@ -327,10 +300,15 @@ double score_all_no_block() {
 
 void save_best_state() {
     best_placements = placements;
+    if (use_lod) {
+        if (best_candidates.size() == LOD_CANDIDATES) best_candidates.erase(best_candidates.begin());
+        best_candidates.push_back(placements);
+    }
 }
 
 void load_best_state() {
     placements = best_placements;
+    grid.build(placements);
     score_all_approximate();
 }
 
@@ -345,15 +323,17 @@ void sa_no_block() {
         }
     }
     placements = best_placements;
+    grid.build(placements);
     double current_score = best_score;
     
     int unchanged = 0;
-    simulated_annealing sa(INIT_TIME_LIMIT);
+    sa::simulated_annealing sa(sa_schedule(INIT_TIME_LIMIT));
     while (!sa.end()) {
         unchanged++;
         if (unchanged == 10000) {
             current_score = best_score;
             placements = best_placements;
+            grid.build(placements);
             unchanged = 0;
         }
         
@@ -365,21 +345,14 @@ void sa_no_block() {
             geo::P next_p = current_p;
             next_p.X += dx;
             next_p.Y += dy;
-            bool ng = false;
-            for (int i = 0; i < placements.size(); i++) {
-                if (i == m) continue;
-                if (dist2(placements[i], next_p) < RADIUS2) {
-                    ng = true;
-                    break;
-                }
-            }
-            if (ng) continue;
+            if (grid.collides(next_p, RADIUS2, m)) continue;
             double next_score = current_score;
             next_score -= score_one_no_block(current_p, problem.musicians[m]);
             next_score += score_one_no_block(next_p, problem.musicians[m]);
             if (sa.accept(current_score, next_score)) {
                 current_score = next_score;
                 placements[m] = next_p;
+                grid.move(m, next_p);
                 if (current_score > best_score) {
                     best_score = current_score;
                     best_placements = placements;
@@ -391,13 +364,17 @@ void sa_no_block() {
             int m2 = random::get(problem.musicians.size() - 1);
             if (m2 >= m1) m2++;
             double next_score = current_score;
-            next_score -= score_one_no_block(placements[m1], problem.musicians[m1]);
-            next_score -= score_one_no_block(placements[m2], problem.musicians[m2]);
-            next_score += score_one_no_block(placements[m1], problem.musicians[m2]);
-            next_score += score_one_no_block(placements[m2], problem.musicians[m1]);
+            double impact1[2], impact2[2];
+            score_two_no_block(placements[m1], problem.musicians[m1], problem.musicians[m2], impact1);
+            score_two_no_block(placements[m2], problem.musicians[m2], problem.musicians[m1], impact2);
+            next_score -= impact1[0];
+            next_score -= impact2[0];
+            next_score += impact1[1];
+            next_score += impact2[1];
             if (sa.accept(current_score, next_score)) {
                 current_score = next_score;
                 swap(placements[m1], placements[m2]);
+                grid.swap_positions(m1, m2);
                 if (current_score > best_score) {
                     best_score = current_score;
                     best_placements = placements;
@@ -413,12 +390,13 @@ int main() {
     
     sa_no_block();
     placements = best_placements;
+    grid.build(placements);
     double best_score = score_all_approximate();
     double current_score = best_score;
     
     int unchanged = 0;
     vector<pair<int, int>> new_blocked;
-    simulated_annealing sa(MAIN_TIME_LIMIT);
+    sa::simulated_annealing sa(sa_schedule(MAIN_TIME_LIMIT));
     while (!sa.end()) {
         unchanged++;
         if (unchanged == 10000) {
@@ -435,15 +413,7 @@ int main() {
             geo::P next_p = current_p;
             next_p.X += dx;
             next_p.Y += dy;
-            bool ng = false;
-            for (int i = 0; i < placements.size(); i++) {
-                if (i == m) continue;
-                if (dist2(placements[i], next_p) < RADIUS2) {
-                    ng = true;
-                    break;
-                }
-            }
-            if (ng) continue;
+            if (grid.collides(next_p, RADIUS2, m)) continue;
             int in = problem.musicians[m];
             for (int i = 0; i < problem.musicians.size(); i++) {
                 tmp_q[i] = q[i];
@@ -460,49 +430,66 @@ int main() {
                 if (i == m) continue;
                 for (int j : blocked_attendees[i][m]) {
                     blocked_count[i][j]--;
-                    if (blocked_count[i][j] == 0) tmp_impact_sum[i] += calc_one_score(placements[i], problem.attendees[j].pos, problem.attendees[j].tastes[problem.musicians[i]]);
+                    if (blocked_count[i][j] == 0) tmp_impact_sum[i] += calc_one_score(placements[i], j, problem.tastes_by_instrument[problem.musicians[i]]);
                 }
             }
-            calc_blocked_one(m, next_p, tmp_attendee_angles, tmp_blocked_attendees, tmp_blocked_count);
-            tmp_impact_sum[m] = 0;
-            for (int i = 0; i < problem.attendees.size(); i++) {
-                if (tmp_blocked_count[i] == 0) tmp_impact_sum[m] += calc_one_score(next_p, problem.attendees[i].pos, problem.attendees[i].tastes[in]);
-            }
             new_blocked.clear();
             for (int i = 0; i < problem.musicians.size(); i++) {
                 if (i == m) continue;
-                double angle = get_angle(placements[i], next_p);
-                double offset = asin(BLOCK_RADIUS / dist(placements[i], next_p));
-                double start = angle - offset;
-                double end = angle + offset;
-                if (start < -M_PI) {
-                    start += M_PI * 2;
-                    end += M_PI * 2;
-                }
-                int index = lower_bound(attendee_angles[i].begin(), attendee_angles[i].end(), make_pair(start, 100000000)) - attendee_angles[i].begin();
-                for (; index < attendee_angles[i].size(); index++) {
-                    if (attendee_angles[i][index].first >= end) break;
-                    int attendee = attendee_angles[i][index].second;
+                attendee_angles[i].for_each_blocked(next_p.X - placements[i].X, next_p.Y - placements[i].Y, BLOCK_RADIUS, [&](int attendee) {
                     new_blocked.emplace_back(i, attendee);
-                    if (blocked_count[i][attendee] == 0) tmp_impact_sum[i] -= calc_one_score(placements[i], problem.attendees[attendee].pos, problem.attendees[attendee].tastes[problem.musicians[i]]);
-                }
+                    if (blocked_count[i][attendee] == 0) tmp_impact_sum[i] -= calc_one_score(placements[i], attendee, problem.tastes_by_instrument[problem.musicians[i]]);
+                });
             }
             double next_score = 0;
             for (int i = 0; i < problem.musicians.size(); i++) {
-                next_score += ceil(VOLUME * tmp_q[i] * max(tmp_impact_sum[i], 0.0));
+                if (i != m) next_score += ceil(VOLUME * tmp_q[i] * max(tmp_impact_sum[i], 0.0));
             }
-            if (sa.accept(current_score, next_score)) {
+            // m 以外の寄与は確定したので、m の寄与に上界を使っても採用の閾値に届かなければ打ち切る
+            // 遮蔽を無視した正の寄与の合計が上界になる。寄与の大きそうな聴衆から計算し、未計算の分は gain_bound で見積もる
+            // 遮蔽の計算 (calc_blocked_one) は上界が閾値を超えたときだけ行う
+            const double score_floor = sa.threshold(current_score);
+            double bound = 0;
+            auto hopeless = [&](double gain) {
+                bound = next_score + ceil(VOLUME * tmp_q[m] * max(gain, 0.0));
+                return bound < score_floor;
+            };
+            const double* tastes = problem.tastes_by_instrument[in];
+            const vector<int>& order = attendee_order[in];
+            bool aborted = hopeless(gain_bound[in][0]);
+            double positive = 0;
+            for (int k = 0; k < order.size() && !aborted; k++) {
+                if ((k & 0x3F) == 0 && k > 0 && hopeless(positive + gain_bound[in][k])) {
+                    aborted = true;
+                    break;
+                }
+                const int j = order[k];
+                tmp_contribution[j] = calc_one_score(next_p, j, tastes);
+                positive += max(tmp_contribution[j], 0.0);
+            }
+            if (!aborted) aborted = hopeless(positive);
+            if (!aborted) {
+                calc_blocked_one(m, next_p, tmp_attendee_angles, attendee_angles[m], tmp_blocked_attendees, tmp_blocked_count.data());
+                tmp_impact_sum[m] = 0;
+                for (int i = 0; i < problem.attendees.size(); i++) {
+                    if (tmp_blocked_count[i] == 0) tmp_impact_sum[m] += tmp_contribution[i];
+                }
+                next_score += ceil(VOLUME * tmp_q[m] * max(tmp_impact_sum[m], 0.0));
+            }
+            // 打ち切った遷移は上界を渡し、悪化する遷移として数えさせる (上界が閾値未満なので必ず不採用)
+            if (sa.accept_threshold(aborted ? bound : next_score, score_floor)) {
                 current_score = next_score;
                 placements[m] = next_p;
-                swap(attendee_angles[m], tmp_attendee_angles);
-                for (int i = 0; i < problem.musicians.size(); i++) blocked_attendees[m][i].swap(tmp_blocked_attendees[i]);
+                grid.move(m, next_p);
+                attendee_angles[m].swap(tmp_attendee_angles);
+                blocked_attendees[m].swap(tmp_blocked_attendees);
                 for (int i = 0; i < problem.attendees.size(); i++) blocked_count[m][i] = tmp_blocked_count[i];
                 for (int i = 0; i < problem.musicians.size(); i++) {
                     if (i == m) continue;
-                    blocked_attendees[i][m].clear();
+                    blocked_attendees[i].clear(m);
                 }
                 for (const pair<int, int>& p : new_blocked) {
-                    blocked_attendees[p.first][m].push_back(p.second);
+                    blocked_attendees[p.first].push_back(m, p.second);
                     blocked_count[p.first][p.second]++;
                 }
                 for (int i = 0; i < problem.musicians.size(); i++) {
@@ -548,23 +535,22 @@ int main() {
             double is1 = 0, is2 = 0;
             next_score -= ceil(VOLUME * q[m1] * max(impact_sum[m1], 0.0));
             next_score -= ceil(VOLUME * q[m2] * max(impact_sum[m2], 0.0));
+            const double* tastes1 = problem.tastes_by_instrument[in1];
+            const double* tastes2 = problem.tastes_by_instrument[in2];
             for (int i = 0; i < problem.attendees.size(); i++) {
-                if (blocked_count[m1][i] == 0) is2 += calc_one_score(placements[m1], problem.attendees[i].pos, problem.attendees[i].tastes[in2]);
-                if (blocked_count[m2][i] == 0) is1 += calc_one_score(placements[m2], problem.attendees[i].pos, problem.attendees[i].tastes[in1]);
+                if (blocked_count[m1][i] == 0) is2 += calc_one_score(placements[m1], i, tastes2);
+                if (blocked_count[m2][i] == 0) is1 += calc_one_score(placements[m2], i, tastes1);
             }
             next_score += ceil(VOLUME * tmp_q[m1] * max(is1, 0.0));
             next_score += ceil(VOLUME * tmp_q[m2] * max(is2, 0.0));
             if (sa.accept(current_score, next_score)) {
                 current_score = next_score;
                 swap(placements[m1], placements[m2]);
+                grid.swap_positions(m1, m2);
                 attendee_angles[m1].swap(attendee_angles[m2]);
-                for (int i = 0; i < problem.musicians.size(); i++) {
-                    if (i == m1 || i == m2) continue;
-                    blocked_attendees[i][m1].swap(blocked_attendees[i][m2]);
-                    blocked_attendees[m1][i].swap(blocked_attendees[m2][i]);
-                }
-                blocked_attendees[m1][m2].swap(blocked_attendees[m2][m1]);
-                for (int i = 0; i < problem.attendees.size(); i++) swap(blocked_count[m1][i], blocked_count[m2][i]);
+                blocked_attendees[m1].swap(blocked_attendees[m2]);
+                for (int i = 0; i < problem.musicians.size(); i++) blocked_attendees[i].swap_columns(m1, m2);
+                blocked_count[m1].swap(blocked_count[m2]);
                 for (int musician : instrument[in1]) q[musician] = tmp_q[musician];
                 for (int musician : instrument[in2]) q[musician] = tmp_q[musician];
                 impact_sum[m1] = is1;
@@ -578,8 +564,29 @@ int main() {
         }
     }
     
-    placements = best_placements;
-    best_score = score_all_exact();
+    if (use_lod) {
+        // 近似の得点で良かった配置を元の問題で計算し直し、一番良いものを出す
+        problem = std::move(exact_problem);
+        setup();
+        if (best_candidates.empty() || best_candidates.back() != best_placements) best_candidates.push_back(best_placements);
+        best_score = -1e18;
+        vector<double> best_volumes;
+        for (const vector<geo::P>& candidate : best_candidates) {
+            placements = candidate;
+            grid.build(placements);
+            double score = score_all_exact();
+            if (score > best_score) {
+                best_score = score;
+                best_placements = candidate;
+                best_volumes = volumes;
+            }
+        }
+        volumes = best_volumes;
+    } else {
+        placements = best_placements;
+        grid.build(placements);
+        best_score = score_all_exact();
+    }
     
     output(best_placements, volumes);
     
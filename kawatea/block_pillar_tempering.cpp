@@ -0,0 +1,206 @@
+#include <cstdio>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include "../library/problem.h"
+#ifndef M_PI
+    #define M_PI 3.14159265358979323846
+#endif
+#include "../library/scoring.h"
+#include "../library/solution.h"
+#include "../library/rng.h"
+#include "../library/simulated_annealing.h"
+#include "../library/incremental_scorer.h"
+
+// block_pillar の並列テンパリング版
+// 温度の違うレプリカを1スレッドに1つずつ回し、ラウンドごとに隣り合う温度の間で配置を交換する
+// 使い方: ./a.out [初期解.json] < problem.json > solution.json
+// 環境変数: THREADS (レプリカ数), PT_T_MAX / PT_T_MIN (温度の範囲), PT_ROUND (1ラウンドの提案数), PT_TIME_LIMIT (秒), SEED
+
+using namespace std;
+
+const double TIME_LIMIT = 250;
+const double RADIUS = 10;
+const double RADIUS2 = RADIUS * RADIUS;
+const double DEFAULT_T_MAX = 10000;
+const double DEFAULT_T_MIN = 10;
+const int DEFAULT_ROUND = 2000;
+manarimo::problem_t problem;
+double stage_left;
+double stage_right;
+double stage_bottom;
+double stage_top;
+double max_diff_width;
+double max_diff_height;
+
+double env_or(const char* name, double fallback) {
+    const char* value = getenv(name);
+    return value != nullptr ? atof(value) : fallback;
+}
+
+void input() {
+    manarimo::load_problem(std::cin, problem);
+
+    stage_left = problem.stage_bottom_left.X;
+    stage_right = stage_left + problem.stage_width;
+    stage_left += RADIUS;
+    stage_right -= RADIUS;
+    max_diff_width = (stage_right - stage_left) / 10;
+
+    stage_bottom = problem.stage_bottom_left.Y;
+    stage_top = stage_bottom + problem.stage_height;
+    stage_bottom += RADIUS;
+    stage_top -= RADIUS;
+    max_diff_height = (stage_top - stage_bottom) / 10;
+}
+
+double dist2(const geo::P& p1, const geo::P& p2) {
+    return (p1.X - p2.X) * (p1.X - p2.X) + (p1.Y - p2.Y) * (p1.Y - p2.Y);
+}
+
+vector<geo::P> random_init(manarimo::rng& rng) {
+    vector<geo::P> placements;
+    for (int i = 0; i < problem.musicians.size(); i++) {
+        while (true) {
+            geo::P p(rng.get_double(stage_left, stage_right), rng.get_double(stage_bottom, stage_top));
+            bool ng = false;
+            for (int j = 0; j < i; j++) {
+                if (dist2(placements[j], p) < RADIUS2) {
+                    ng = true;
+                    break;
+                }
+            }
+            if (!ng) {
+                placements.push_back(p);
+                break;
+            }
+        }
+    }
+    return placements;
+}
+
+// 1つの温度で回す SA の状態。スコア計算の状態と乱数はレプリカごとに持つ
+struct replica {
+    manarimo::incremental_scorer scorer;
+    manarimo::rng rng;
+    double best_score;
+    vector<geo::P> best_placements;
+    int accepted = 0;
+    int proposed = 0;
+
+    replica(const vector<geo::P>& placements, const manarimo::rng& rng) : scorer(problem, placements), rng(rng), best_score(scorer.score()), best_placements(placements) {}
+
+    // 温度 temp で iterations 回提案する
+    void run(double temp, int iterations) {
+        const int n_musician = problem.musicians.size();
+        for (int iter = 0; iter < iterations; iter++) {
+            double next_score;
+            if (rng.get(100) < 80 || n_musician < 2) {
+                int m = rng.get(n_musician);
+                const geo::P& current_p = scorer.get_placements()[m];
+                geo::P next_p = current_p;
+                next_p.X += clamp(rng.get_double(-max_diff_width, max_diff_width), stage_left - current_p.X, stage_right - current_p.X);
+                next_p.Y += clamp(rng.get_double(-max_diff_height, max_diff_height), stage_bottom - current_p.Y, stage_top - current_p.Y);
+                if (!scorer.is_valid_position(m, next_p)) continue;
+                next_score = scorer.propose_move(m, next_p);
+            } else {
+                int m1 = rng.get(n_musician);
+                int m2 = rng.get(n_musician - 1);
+                if (m2 >= m1) m2++;
+                if (problem.musicians[m1] == problem.musicians[m2]) continue;
+                next_score = scorer.propose_swap(m1, m2);
+            }
+            proposed++;
+            double diff = next_score - scorer.score();
+            if (diff >= 0 || log(rng.probability()) * temp < diff) {
+                scorer.commit();
+                accepted++;
+                if (scorer.score() > best_score) {
+                    best_score = scorer.score();
+                    best_placements = scorer.get_placements();
+                }
+            } else {
+                scorer.rollback();
+            }
+        }
+    }
+};
+
+int main(int argc, char** argv) {
+    input();
+
+    manarimo::rng root(manarimo::seed_from_env());
+    const int n_replica = max(2, (int) env_or("THREADS", max(1u, thread::hardware_concurrency())));
+    const double t_max = env_or("PT_T_MAX", DEFAULT_T_MAX);
+    const double t_min = env_or("PT_T_MIN", DEFAULT_T_MIN);
+    const int round = max(1, (int) env_or("PT_ROUND", DEFAULT_ROUND));
+    const double time_limit = env_or("PT_TIME_LIMIT", TIME_LIMIT);
+
+    vector<geo::P> initial;
+    if (argc > 1) {
+        manarimo::solution_t solution;
+        manarimo::load_solution(string(argv[1]), solution);
+        initial = solution.as_p();
+    } else {
+        initial = random_init(root);
+    }
+
+    // temps[k] は k 番目に高い温度。slot[k] がその温度を担当しているレプリカ
+    vector<double> temps(n_replica);
+    for (int k = 0; k < n_replica; k++) temps[k] = t_max * pow(t_min / t_max, (double) k / (n_replica - 1));
+    vector<int> slot(n_replica);
+    vector<replica> replicas;
+    replicas.reserve(n_replica);
+    for (int k = 0; k < n_replica; k++) {
+        replicas.emplace_back(initial, root.split());
+        slot[k] = k;
+    }
+
+    // スレッドはラウンドごとに作らず、最初に作ったものを使い回す
+    manarimo::worker_pool pool(n_replica);
+    sa::timer timer;
+    timer.start();
+    int rounds = 0;
+    int exchanged = 0;
+    int exchange_tried = 0;
+    while (timer.get_time() < time_limit) {
+        pool.run(n_replica, [&](int k, int) {
+            replicas[slot[k]].run(temps[k], round);
+        });
+
+        // 偶数ラウンドは (0,1) (2,3) ...、奇数ラウンドは (1,2) (3,4) ... の組で交換を試みる
+        for (int k = rounds % 2; k + 1 < n_replica; k += 2) {
+            const double s_hot = replicas[slot[k]].scorer.score();
+            const double s_cold = replicas[slot[k + 1]].scorer.score();
+            const double log_ratio = (s_hot - s_cold) * (1 / temps[k + 1] - 1 / temps[k]);
+            exchange_tried++;
+            if (log_ratio >= 0 || log(root.probability()) < log_ratio) {
+                swap(slot[k], slot[k + 1]);
+                exchanged++;
+            }
+        }
+        rounds++;
+    }
+
+    int best = 0;
+    for (int i = 1; i < n_replica; i++) {
+        if (replicas[i].best_score > replicas[best].best_score) best = i;
+    }
+    for (int k = 0; k < n_replica; k++) {
+        const replica& r = replicas[slot[k]];
+        fprintf(stderr, "temp = %.3g, score = %.0f, best = %.0f, accept = %d / %d\n", temps[k], r.scorer.score(), r.best_score, r.accepted, r.proposed);
+    }
+    fprintf(stderr, "rounds = %d, exchange = %d / %d\n", rounds, exchanged, exchange_tried);
+    fprintf(stderr, "best = %.0f\n", replicas[best].best_score);
+
+    const vector<geo::P>& best_placements = replicas[best].best_placements;
+    manarimo::incremental_scorer final_scorer(problem, best_placements);
+    // 焼きなましのスコアは近似なので、出力する解を manarimo::score でも計算しておく
+    fprintf(stderr, "approximate = %.0f, exact = %lld\n", final_scorer.score(), final_scorer.exact_score());
+    manarimo::print_solution(std::cout, best_placements, final_scorer.volumes());
+
+    return 0;
+}
@@ -8,6 +8,8 @@
     #define M_PI 3.14159265358979323846
 #endif
 #include "../library/scoring.h"
+#include "../library/rng.h"
+#include "../library/impact_kernels.h"
 
 using namespace std;
 
@@ -36,7 +38,7 @@ class random {
     public:
     // [0, x)
     inline static unsigned get(unsigned x) {
-        return ((unsigned long long)xorshift() * x) >> 32;
+        return generator().get(x);
     }
     
     // [x, y]
@@ -46,12 +48,12 @@ class random {
     
     // [0, x] (x = 2^c - 1)
     inline static unsigned get_fast(unsigned x) {
-        return xorshift() & x;
+        return generator().get_fast(x);
     }
     
-    // [0.0, 1.0]
+    // (0.0, 1.0)
     inline static double probability() {
-        return xorshift() * INV_MAX;
+        return generator().probability();
     }
     
     inline static double get_double(double x, double y) {
@@ -59,17 +61,13 @@ class random {
     }
     
     inline static bool toss() {
-        return xorshift() & 1;
+        return generator().toss();
     }
     
-    private:
-    constexpr static double INV_MAX = 1.0 / 0xFFFFFFFF;
-    
-    inline static unsigned xorshift() {
-        static unsigned x = 123456789, y = 362436039, z = 521288629, w = 88675123;
-        unsigned t = x ^ (x << 11);
-        x = y, y = z, z = w;
-        return w = (w ^ (w >> 19)) ^ (t ^ (t >> 8));
+    // スレッドごとに持つ xoshiro256** (library/rng.h)。SEED 環境変数で系列を固定できる
+    static manarimo::rng& generator() {
+        static thread_local manarimo::rng instance(manarimo::seed_from_env());
+        return instance;
     }
 };
 
@@ -198,11 +196,13 @@ void random_init() {
 }
 
 double score_one(const geo::P& p, int musician) {
-    double sum = 0;
-    for (const manarimo::atendee_t& a : problem.attendees) {
-        sum += ceil(1000000 * a.tastes[musician] / dist2(p, geo::P(a.x, a.y)));
-    }
-    return sum;
+    return manarimo::no_block_impact(problem.attendee_x_data, problem.attendee_y_data, problem.attendees.size(), p.X, p.Y, problem.tastes_by_instrument[musician]);
+}
+
+// p にいる演奏家の楽器が musician1 だったときと musician2 だったときの score_one を out[0], out[1] に入れる
+void score_two(const geo::P& p, int musician1, int musician2, double* out) {
+    const double* tastes[2] = {problem.tastes_by_instrument[musician1], problem.tastes_by_instrument[musician2]};
+    manarimo::no_block_impacts<2>(problem.attendee_x_data, problem.attendee_y_data, problem.attendees.size(), p.X, p.Y, tastes, out);
 }
 
 double score_all() {
@@ -271,10 +271,13 @@ int main() {
             int m2 = random::get(problem.musicians.size() - 1);
             if (m2 >= m1) m2++;
             double next_score = current_score;
-            next_score -= score_one(placements[m1], problem.musicians[m1]);
-            next_score -= score_one(placements[m2], problem.musicians[m2]);
-            next_score += score_one(placements[m1], problem.musicians[m2]);
-            next_score += score_one(placements[m2], problem.musicians[m1]);
+            double impact1[2], impact2[2];
+            score_two(placements[m1], problem.musicians[m1], problem.musicians[m2], impact1);
+            score_two(placements[m2], problem.musicians[m2], problem.musicians[m1], impact2);
+            next_score -= impact1[0];
+            next_score -= impact2[0];
+            next_score += impact1[1];
+            next_score += impact2[1];
             if (sa.accept(current_score, next_score)) {
                 current_score = next_score;
                 swap(placements[m1], placements[m2]);
@@ -0,0 +1,170 @@
+#ifndef ICFPC2023_ANGULAR_INDEX_H
+#define ICFPC2023_ANGULAR_INDEX_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "geometry_kernels.h"
+
+namespace manarimo {
+    using namespace std;
+
+    // tangent_angles の結果を走査用の区間 [start, end) に直す
+    // 境目をまたぐときは end を +4 する。視点が円の中にある (NaN) ときは false
+    inline bool tangent_range(double& start, double& end) {
+        if (!(start <= 2 && end <= 2)) return false;
+        if (end < start) end += 4;
+        return true;
+    }
+
+    // 視点から (dx, dy) にある半径 r の円が隠す擬似角度の区間
+    inline bool tangent_range(double dx, double dy, double r, double& start, double& end) {
+        tangent_angles(dx, dy, r, start, end);
+        return tangent_range(start, end);
+    }
+
+    // ある視点から見た聴衆を擬似角度の昇順に並べたもの
+    // 後ろ半分に角度 +4 の複製を持つので、境目をまたぐ区間も連続に走査できる
+    // 少しだけ動いたときは前の並びを種に挿入ソートし、崩れが大きければバケットソートで作り直す
+    class angular_index {
+        public:
+        void init(const double* xs, const double* ys, int n) {
+            this->xs = xs;
+            this->ys = ys;
+            this->n = n;
+            angles.clear();
+            ids.clear();
+        }
+
+        // (cx, cy) から見た並びを一から作る
+        void build(double cx, double cy) {
+            this->cx = cx;
+            this->cy = cy;
+            angles.resize(n * 2);
+            ids.resize(n * 2);
+            pseudo_angles(xs, ys, n, cx, cy, angles.data());
+            for (int i = 0; i < n; i++) ids[i] = i;
+            bucket_sort();
+            duplicate();
+        }
+
+        // previous の並びを種にして (cx, cy) から見た並びを作る。previous は自分自身でもよい
+        void build_from(const angular_index& previous, double cx, double cy) {
+            if ((int) previous.ids.size() != n * 2) {
+                build(cx, cy);
+                return;
+            }
+            this->cx = cx;
+            this->cy = cy;
+            angles.resize(n * 2);
+            ids.resize(n * 2);
+            if (&previous != this) copy(previous.ids.begin(), previous.ids.begin() + n, ids.begin());
+            pseudo_angles(xs, ys, ids.data(), n, cx, cy, angles.data());
+            if (!insertion_sort(n * 4)) bucket_sort();
+            duplicate();
+        }
+
+        // (dx, dy) にある半径 r の円に隠される聴衆それぞれについて f(attendee) を呼ぶ
+        template<class F>
+        void for_each_blocked(double dx, double dy, double r, F f) const {
+            double start, end;
+            if (!tangent_range(dx, dy, r, start, end)) return;
+            scan(start, end, f);
+        }
+
+        // centers[i] を中心とする半径 r の円それぞれについて、隠される聴衆ごとに f(i, attendee) を呼ぶ
+        // 接線はまとめて計算する。視点と重なる円は飛ばす
+        template<class F>
+        void for_each_blocked(const pair<double, double>* centers, int n_centers, double r, F f) const {
+            static thread_local vector<double> starts, ends;
+            starts.resize(n_centers);
+            ends.resize(n_centers);
+            tangent_angles(centers, n_centers, cx, cy, r, starts.data(), ends.data());
+            for (int i = 0; i < n_centers; i++) {
+                double start = starts[i], end = ends[i];
+                if (!tangent_range(start, end)) continue;
+                scan(start, end, [&](int attendee) { f(i, attendee); });
+            }
+        }
+
+        void swap(angular_index& other) {
+            angles.swap(other.angles);
+            ids.swap(other.ids);
+            std::swap(cx, other.cx);
+            std::swap(cy, other.cy);
+        }
+
+        private:
+        const double* xs = nullptr;
+        const double* ys = nullptr;
+        int n = 0;
+        double cx = 0;
+        double cy = 0;
+        vector<double> angles;
+        vector<int> ids;
+
+        template<class F>
+        void scan(double start, double end, F f) const {
+            int index = upper_bound(angles.begin(), angles.end(), start) - angles.begin();
+            for (; index < (int) angles.size(); index++) {
+                if (angles[index] >= end) break;
+                f(ids[index]);
+            }
+        }
+
+        void duplicate() {
+            for (int i = 0; i < n; i++) {
+                angles[n + i] = angles[i] + 4;
+                ids[n + i] = ids[i];
+            }
+        }
+
+        // 前半 n 個を (角度, 番号) の順に挿入ソートする。ずらした回数が limit を超えたら諦めて false
+        bool insertion_sort(long long limit) {
+            long long shifted = 0;
+            for (int i = 1; i < n; i++) {
+                double a = angles[i];
+                int id = ids[i];
+                int j = i;
+                while (j > 0 && (a < angles[j - 1] || (a == angles[j - 1] && id < ids[j - 1]))) {
+                    angles[j] = angles[j - 1];
+                    ids[j] = ids[j - 1];
+                    j--;
+                    if (++shifted > limit) {
+                        angles[j] = a;
+                        ids[j] = id;
+                        return false;
+                    }
+                }
+                angles[j] = a;
+                ids[j] = id;
+            }
+            return true;
+        }
+
+        // 前半 n 個を擬似角度で n 個のバケットに振り分けてから、バケットごとにソートする
+        void bucket_sort() {
+            static thread_local vector<pair<double, int>> scratch;
+            static thread_local vector<int> bucket_start;
+            scratch.resize(n);
+            bucket_start.assign(n + 1, 0);
+            auto bucket_of = [this](double angle) { return min(n - 1, max(0, (int) ((angle + 2) * n / 4))); };
+            for (int i = 0; i < n; i++) bucket_start[bucket_of(angles[i]) + 1]++;
+            for (int b = 0; b < n; b++) bucket_start[b + 1] += bucket_start[b];
+            for (int i = 0; i < n; i++) scratch[bucket_start[bucket_of(angles[i])]++] = make_pair(angles[i], ids[i]);
+            // 振り分けで bucket_start[b] はバケット b の末尾 (= b + 1 の先頭) になっている
+            int begin = 0;
+            for (int b = 0; b < n; b++) {
+                int end = bucket_start[b];
+                if (end - begin > 1) sort(scratch.begin() + begin, scratch.begin() + end);
+                begin = end;
+            }
+            for (int i = 0; i < n; i++) {
+                angles[i] = scratch[i].first;
+                ids[i] = scratch[i].second;
+            }
+        }
+    };
+};
+
+#endif //ICFPC2023_ANGULAR_INDEX_H
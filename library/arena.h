@@ -0,0 +1,118 @@
+#ifndef ICFPC2023_ARENA_H
+#define ICFPC2023_ARENA_H
+
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
+
+namespace manarimo {
+    using namespace std;
+
+    // SA の1提案ごとに使い捨てる作業領域
+    // allocate はポインタを進めるだけで、reset() で先頭に巻き戻す。個別の解放はしない
+    // 溢れたときだけ追加の塊を確保し、次の reset() で全体を1つの大きな塊にまとめ直すので、定常状態ではヒープ確保が起きない
+    class arena {
+        public:
+        explicit arena(size_t initial_bytes = 1 << 16) : capacity(initial_bytes), used(0), overflow_bytes(0) {
+            head.reset(new char[capacity]);
+        }
+
+        arena(const arena&) = delete;
+        arena& operator=(const arena&) = delete;
+
+        void* allocate(size_t bytes, size_t align) {
+            size_t start = (used + align - 1) / align * align;
+            if (start + bytes <= capacity) {
+                used = start + bytes;
+                return head.get() + start;
+            }
+            // 溢れた分は個別に確保しておき、reset() で head に吸収する
+            overflow.emplace_back(new char[bytes + align]);
+            overflow_bytes += bytes + align;
+            char* p = overflow.back().get();
+            size_t misalign = reinterpret_cast<size_t>(p) % align;
+            return misalign == 0 ? p : p + (align - misalign);
+        }
+
+        template<class T>
+        T* allocate(size_t n) {
+            return static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+        }
+
+        void reset() {
+            if (!overflow.empty()) {
+                capacity = max(capacity * 2, capacity + overflow_bytes);
+                head.reset(new char[capacity]);
+                overflow.clear();
+                overflow_bytes = 0;
+            }
+            used = 0;
+        }
+
+        private:
+        unique_ptr<char[]> head;
+        size_t capacity;
+        size_t used;
+        vector<unique_ptr<char[]>> overflow;
+        size_t overflow_bytes;
+    };
+
+    // arena 上に取る可変長配列。伸ばすときは新しい領域を arena から取ってコピーし、古い領域は reset() まで放置する
+    // 中身は memcpy で運ぶので trivially copyable な型に限る
+    template<class T>
+    class arena_vector {
+        static_assert(is_trivially_copyable<T>::value, "arena_vector only holds trivially copyable types");
+
+        public:
+        explicit arena_vector(arena& a, int initial_capacity = 16) : a(a), ptr(a.allocate<T>(initial_capacity)), n(0), cap(initial_capacity) {}
+
+        void push_back(const T& value) {
+            if (n == cap) grow();
+            ptr[n++] = value;
+        }
+
+        template<class... Args>
+        void emplace_back(Args&&... args) {
+            push_back(T(std::forward<Args>(args)...));
+        }
+
+        void clear() { n = 0; }
+        int size() const { return n; }
+        bool empty() const { return n == 0; }
+
+        bool contains(const T& value) const {
+            return find(begin(), end(), value) != end();
+        }
+
+        T& operator[](int i) { return ptr[i]; }
+        const T& operator[](int i) const { return ptr[i]; }
+        T* begin() { return ptr; }
+        T* end() { return ptr + n; }
+        const T* begin() const { return ptr; }
+        const T* end() const { return ptr + n; }
+
+        void swap(arena_vector& other) {
+            std::swap(ptr, other.ptr);
+            std::swap(n, other.n);
+            std::swap(cap, other.cap);
+        }
+
+        private:
+        arena& a;
+        T* ptr;
+        int n;
+        int cap;
+
+        void grow() {
+            T* next = a.allocate<T>(cap * 2);
+            memcpy(next, ptr, sizeof(T) * n);
+            ptr = next;
+            cap *= 2;
+        }
+    };
+};
+
+#endif //ICFPC2023_ARENA_H
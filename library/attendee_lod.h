@@ -0,0 +1,114 @@
+#ifndef ICFPC2023_ATTENDEE_LOD_H
+#define ICFPC2023_ATTENDEE_LOD_H
+
+#include <vector>
+#include <map>
+#include <tuple>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include "problem.h"
+#include "attendee_pruning.h"
+
+namespace manarimo {
+    using namespace std;
+    using namespace geo;
+
+    // ステージから遠い聴衆を、近くの聴衆とまとめて1人の代表にした近似の問題
+    // 代表は位置が重心で、好みがまとめた聴衆の好みの和。遠くでは 1000000 * taste / d^2 がゆっくりしか変わらないので、影響の和はほぼ変わらない
+    // 聴衆の数が減るので、SA の1手ごとの O(A) のループと遮蔽の計算が軽くなる。得点は近似なので、最後に元の問題で計算し直すこと
+    //
+    // まとめた聴衆 i は、代表との距離が tolerance * (i と演奏家を置ける範囲の距離) 以下
+    // よって演奏家がどこにいても代表との距離は i との距離の (1 ± tolerance) 倍に収まり、i の項の誤差は 1000000 * |taste| / D_i^2 * ((1 - tolerance)^-2 - 1) 以下
+    // ceil をまとめて1回にする分の誤差は、まとめた聴衆1人あたり 1 以下
+    // 遮蔽は代表の方向だけで判定するので、その違いは誤差の上界に含まない
+    struct attendee_lod {
+        vector<int> cluster_of;       // cluster_of[i]: 元の聴衆 i を含む代表
+        vector<int> member_offset;    // 代表 c には members[member_offset[c]..member_offset[c + 1]) をまとめてある
+        vector<int> members;
+        vector<number> impact_error;  // impact_error[k]: 楽器 k の演奏家1人の、遮蔽がないときの影響の和の誤差の上界
+        int n_original = 0;
+    };
+
+    // tolerance <= 0 なら誰もまとめない (out は problem と同じ聴衆になる)
+    inline attendee_lod build_attendee_lod(const problem_t& problem, problem_t& out, number tolerance) {
+        const int n_attendee = problem.n_attendees();
+        P corners[4];
+        placeable_corners(problem, corners);
+
+        // 大きさ 2^level の区画で分けると、同じ区画の聴衆と重心の距離は 2^level * sqrt(2) 以下
+        // 聴衆ごとに、その距離が tolerance * D_i 以下になる一番大きい level の区画に入れる。1 より小さい区画ではまとめない
+        map<tuple<int, long long, long long>, int> cell_cluster;
+        attendee_lod lod;
+        lod.n_original = n_attendee;
+        lod.cluster_of.assign(n_attendee, -1);
+        vector<vector<int>> clusters;
+        vector<number> dist(n_attendee);
+        for (int i = 0; i < n_attendee; i++) {
+            const P& a = problem.attendees[i].pos;
+            dist[i] = sqrt(placeable_dist2(corners, a));
+            const number reach = tolerance * dist[i] / sqrt(2.0);
+            if (tolerance <= 0 || tolerance >= 1 || reach < 1) {
+                lod.cluster_of[i] = clusters.size();
+                clusters.push_back({i});
+                continue;
+            }
+            const int level = (int) floor(log2(reach));
+            const number size = ldexp(1.0, level);
+            const auto key = make_tuple(level, (long long) floor(a.first / size), (long long) floor(a.second / size));
+            auto it = cell_cluster.find(key);
+            if (it == cell_cluster.end()) {
+                it = cell_cluster.emplace(key, (int) clusters.size()).first;
+                clusters.emplace_back();
+            }
+            lod.cluster_of[i] = it->second;
+            clusters[it->second].push_back(i);
+        }
+
+        const int n_instruments = problem.n_instruments;
+        const number spread = tolerance > 0 && tolerance < 1 ? 1 / ((1 - tolerance) * (1 - tolerance)) - 1 : 0;
+        lod.impact_error.assign(n_instruments, 0);
+        lod.member_offset.assign(1, 0);
+        problem_t approximate;
+        approximate.room_width = problem.room_width;
+        approximate.room_height = problem.room_height;
+        approximate.stage_width = problem.stage_width;
+        approximate.stage_height = problem.stage_height;
+        approximate.stage_bottom_left = problem.stage_bottom_left;
+        approximate.musicians = problem.musicians;
+        approximate.pillars = problem.pillars;
+        approximate.playing_together = problem.playing_together;
+        for (const vector<int>& cluster : clusters) {
+            number x = 0, y = 0;
+            const size_t row = approximate.tastes.size();
+            approximate.tastes.resize(row + n_instruments, 0);
+            for (int i : cluster) {
+                x += problem.attendee_x_data[i];
+                y += problem.attendee_y_data[i];
+                for (int k = 0; k < n_instruments; k++) approximate.tastes[row + k] += problem.taste(i, k);
+                if (cluster.size() > 1) {
+                    for (int k = 0; k < n_instruments; k++) lod.impact_error[k] += 1000000 * fabs(problem.taste(i, k)) / (dist[i] * dist[i]) * spread + 1;
+                }
+                lod.members.push_back(i);
+            }
+            approximate.attendee_x.push_back(x / cluster.size());
+            approximate.attendee_y.push_back(y / cluster.size());
+            lod.member_offset.push_back(lod.members.size());
+        }
+        approximate.init();
+        if (approximate.attendee_count == 0) {
+            approximate.n_instruments = n_instruments;
+            approximate.tastes_by_instrument.assign(n_instruments, nullptr);
+        }
+        out = std::move(approximate);
+        return lod;
+    }
+
+    // 環境変数 LOD_TOLERANCE があればその値、なければ 0 (まとめない)
+    inline number lod_tolerance_from_env() {
+        if (const char* v = getenv("LOD_TOLERANCE")) return atof(v);
+        return 0;
+    }
+};
+
+#endif //ICFPC2023_ATTENDEE_LOD_H
@@ -0,0 +1,183 @@
+#ifndef ICFPC2023_ATTENDEE_PRUNING_H
+#define ICFPC2023_ATTENDEE_PRUNING_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <cstdlib>
+#include "problem.h"
+#include "pillar_index.h"
+
+namespace manarimo {
+    using namespace std;
+    using namespace geo;
+
+    // 得点に関係しない聴衆を問題から除く前処理
+    // hidden: 柱でステージ全体から隠れる聴衆 (amylase/adelphel/test.cpp と同じ判定に、柱がステージより手前にあることを足したもの)
+    // negligible: どこに演奏家を置いても得点への影響の絶対値が epsilon 以下の聴衆
+    // epsilon = 0 なら除いた聴衆の影響はどの配置でもちょうど 0 なので、除いた問題での得点は元の問題での得点と一致する
+    struct attendee_map {
+        vector<int> original_ids;   // original_ids[i]: 除いた後の聴衆 i の元の番号
+        int n_original = 0;
+        int n_hidden = 0;
+        int n_negligible = 0;
+
+        // 元の番号から除いた後の番号。除いた聴衆なら -1
+        vector<int> pruned_ids() const {
+            vector<int> ids(n_original, -1);
+            for (int i = 0; i < (int) original_ids.size(); i++) ids[original_ids[i]] = i;
+            return ids;
+        }
+    };
+
+    // 演奏家を置ける範囲 (ステージから radius だけ内側) の 左下, 左上, 右下, 右上
+    inline void placeable_corners(const problem_t& problem, P (&corners)[4], number radius = 10) {
+        const number left = problem.stage_bottom_left.first + min(radius, problem.stage_width / 2);
+        const number right = problem.stage_bottom_left.first + problem.stage_width - min(radius, problem.stage_width / 2);
+        const number bottom = problem.stage_bottom_left.second + min(radius, problem.stage_height / 2);
+        const number top = problem.stage_bottom_left.second + problem.stage_height - min(radius, problem.stage_height / 2);
+        corners[0] = P(left, bottom);
+        corners[1] = P(left, top);
+        corners[2] = P(right, bottom);
+        corners[3] = P(right, top);
+    }
+
+    // 演奏家を置ける範囲と p の距離の2乗
+    inline number placeable_dist2(const P (&corners)[4], const P& p) {
+        const number dx = max({0.0, corners[0].first - p.first, p.first - corners[3].first});
+        const number dy = max({0.0, corners[0].second - p.second, p.second - corners[3].second});
+        return dx * dx + dy * dy;
+    }
+
+    // 演奏家を置けるどの点を見ても、その手前にある柱に隠れるか
+    // スコア計算 (get_unblocked_musician_of_attendee) は有効な柱の角度の範囲だけで判定するので、有効な柱だけを使う
+    // 実際の遮蔽 (線分と円の交差) でも隠れるよう、聴衆から柱の中心までが演奏家を置ける範囲より近い柱だけを使い、角度の範囲は少し狭めて扱う
+    inline bool is_hidden_by_pillars(const problem_t& problem, int attendee) {
+        if (problem.pillars.empty()) return false;
+        const P stage_corners[4] = {
+            {problem.stage_bottom_left.first, problem.stage_bottom_left.second},
+            {problem.stage_bottom_left.first, problem.stage_bottom_left.second + problem.stage_height},
+            {problem.stage_bottom_left.first + problem.stage_width, problem.stage_bottom_left.second},
+            {problem.stage_bottom_left.first + problem.stage_width, problem.stage_bottom_left.second + problem.stage_height},
+        };
+        P corners[4];
+        placeable_corners(problem, corners);
+        const P& a = problem.attendees[attendee].pos;
+        const number stage_dist2 = placeable_dist2(corners, a);
+        if (stage_dist2 == 0) return false;
+
+        // 演奏家を置ける範囲の中心方向を 0 とした角度で考える。範囲の外から見るので、範囲は (-pi/2, pi/2) に収まる
+        const number ref = atan2((corners[0].second + corners[3].second) / 2 - a.second, (corners[0].first + corners[3].first) / 2 - a.first);
+        auto relative_angle = [&](const P& p) {
+            number angle = atan2(p.second - a.second, p.first - a.first) - ref;
+            while (angle < -M_PI) angle += 2 * M_PI;
+            while (angle > M_PI) angle -= 2 * M_PI;
+            return angle;
+        };
+        number lo = numeric_limits<number>::infinity(), hi = -numeric_limits<number>::infinity();
+        for (const P& c : corners) {
+            lo = min(lo, relative_angle(c));
+            hi = max(hi, relative_angle(c));
+        }
+
+        vector<pair<number, number>> spans;
+        for (const pillar_t& pillar : problem.pillars) {
+            if (!is_pillar_effective(a, stage_corners, pillar)) continue;
+            const number dx = pillar.center.first - a.first, dy = pillar.center.second - a.second;
+            const number dist2 = dx * dx + dy * dy;
+            // 柱の中の聴衆からはどこも見えない
+            if (dist2 < pillar.radius * pillar.radius) return true;
+            if (dist2 > stage_dist2) continue;
+            const number mid = relative_angle(pillar.center);
+            const number offset = asin(pillar.radius / sqrt(dist2)) - 1e-9;
+            if (offset > 0) spans.emplace_back(mid - offset, mid + offset);
+        }
+        sort(spans.begin(), spans.end());
+        number covered = lo;
+        for (const auto& span : spans) {
+            if (span.first > covered) break;
+            covered = max(covered, span.second);
+            if (covered > hi) return true;
+        }
+        return false;
+    }
+
+    // 聴衆 attendee の得点への影響の絶対値の上界
+    // 演奏家ごとの項 ceil(volume * closeness * ceil(1000000 * taste / d^2)) を、volume <= 10、closeness <= 1 + (同じ楽器の人数 - 1) / 10 (演奏家同士は距離 10 以上) で抑える
+    inline number max_contribution(const problem_t& problem, int attendee, const vector<int>& instrument_count) {
+        P corners[4];
+        placeable_corners(problem, corners);
+        const number dist2 = placeable_dist2(corners, problem.attendees[attendee].pos);
+        number bound = 0;
+        for (int k = 0; k < problem.n_instruments; k++) {
+            if (instrument_count[k] == 0) continue;
+            const number taste = problem.taste(attendee, k);
+            if (taste == 0) continue;
+            if (dist2 == 0) return numeric_limits<number>::infinity();
+            // taste > 0 なら距離が最小のとき最大。taste < 0 なら ceil で 0 側に丸まるので絶対値は floor
+            const number impact = taste > 0 ? ceil(1000000 * taste / dist2) : floor(-1000000 * taste / dist2);
+            if (impact == 0) continue;
+            const number closeness = problem.playing_together ? 1 + (instrument_count[k] - 1) / 10.0 : 1;
+            bound += instrument_count[k] * (10 * closeness * impact + 1);
+        }
+        return bound;
+    }
+
+    // problem から除ける聴衆を除いたものを out に作る。柱・演奏家などはそのまま
+    inline attendee_map prune_attendees(const problem_t& problem, problem_t& out, number epsilon = 0) {
+        const int n_attendee = problem.n_attendees();
+        vector<int> instrument_count(problem.n_instruments, 0);
+        for (int m : problem.musicians) instrument_count[m]++;
+
+        attendee_map map;
+        map.n_original = n_attendee;
+        for (int i = 0; i < n_attendee; i++) {
+            if (is_hidden_by_pillars(problem, i)) {
+                map.n_hidden++;
+            } else if (max_contribution(problem, i, instrument_count) <= epsilon) {
+                map.n_negligible++;
+            } else {
+                map.original_ids.push_back(i);
+            }
+        }
+
+        problem_t pruned;
+        pruned.room_width = problem.room_width;
+        pruned.room_height = problem.room_height;
+        pruned.stage_width = problem.stage_width;
+        pruned.stage_height = problem.stage_height;
+        pruned.stage_bottom_left = problem.stage_bottom_left;
+        pruned.musicians = problem.musicians;
+        pruned.pillars = problem.pillars;
+        pruned.playing_together = problem.playing_together;
+        for (int i : map.original_ids) {
+            pruned.attendee_x.push_back(problem.attendee_x_data[i]);
+            pruned.attendee_y.push_back(problem.attendee_y_data[i]);
+            pruned.tastes.insert(pruned.tastes.end(), problem.taste_row_of(i), problem.taste_row_of(i) + problem.n_instruments);
+        }
+        pruned.init();
+        // 聴衆が全員いなくなると init で楽器の数が分からなくなるので戻しておく
+        if (pruned.attendee_count == 0) {
+            pruned.n_instruments = problem.n_instruments;
+            pruned.tastes_by_instrument.assign(problem.n_instruments, nullptr);
+        }
+        out = std::move(pruned);
+        return map;
+    }
+
+    // 環境変数 PRUNE_EPSILON があればその値、なければ 0 (得点が変わらない聴衆だけ除く)
+    inline number prune_epsilon_from_env() {
+        if (const char* v = getenv("PRUNE_EPSILON")) return atof(v);
+        return 0;
+    }
+
+    // load_problem で読んでから prune_attendees する
+    inline attendee_map load_pruned_problem(istream& f, problem_t& out, number epsilon = prune_epsilon_from_env()) {
+        problem_t problem;
+        load_problem(f, problem);
+        return prune_attendees(problem, out, epsilon);
+    }
+};
+
+#endif //ICFPC2023_ATTENDEE_PRUNING_H
@@ -0,0 +1,102 @@
+#ifndef ICFPC2023_BLOCKED_LISTS_H
+#define ICFPC2023_BLOCKED_LISTS_H
+
+#include <vector>
+#include <algorithm>
+
+namespace manarimo {
+    using namespace std;
+
+    // 演奏家 i から見て、演奏家 k ごとにブロックされている聴衆のリスト (blocked_attendees[i][k]) の1行分
+    // vector<int>[MAX_MUSICIAN][MAX_MUSICIAN] の代わりに、1行を1本の配列に詰めて (offset, len) で区切る
+    // 列 k を書き換えると古い区間は捨てて末尾に追記し、捨てた分が増えたら詰め直す
+    class blocked_row {
+        public:
+        struct segment {
+            const int* first;
+            const int* last;
+            const int* begin() const { return first; }
+            const int* end() const { return last; }
+            int size() const { return last - first; }
+            bool empty() const { return first == last; }
+        };
+
+        blocked_row() {}
+        explicit blocked_row(int n_musician) : offset(n_musician, 0), len(n_musician, 0) {}
+
+        // n_musician 列の空の行にする
+        void reset(int n_musician) {
+            offset.assign(n_musician, 0);
+            len.assign(n_musician, 0);
+            data.clear();
+            dead = 0;
+        }
+
+        segment operator[](int k) const {
+            const int* base = data.data() + offset[k];
+            return {base, base + len[k]};
+        }
+
+        // 行全体を空にする
+        void clear() {
+            fill(len.begin(), len.end(), 0);
+            data.clear();
+            dead = 0;
+        }
+
+        // 列 k を空にする
+        void clear(int k) {
+            dead += len[k];
+            len[k] = 0;
+            if (dead > 1024 && dead * 2 > (int) data.size()) compact();
+        }
+
+        // 列 k の末尾に追加する。同じ列への追加は他の列への追加を挟まずに続けて行うこと
+        void push_back(int k, int attendee) {
+            if (len[k] == 0) {
+                offset[k] = data.size();
+            } else if (offset[k] + len[k] != (int) data.size()) {
+                // 途中に他の列が割り込んだので、列 k を末尾に付け替える
+                const int old = offset[k];
+                offset[k] = data.size();
+                for (int i = 0; i < len[k]; i++) data.push_back(data[old + i]);
+                dead += len[k];
+            }
+            data.push_back(attendee);
+            len[k]++;
+        }
+
+        void swap_columns(int k1, int k2) {
+            std::swap(offset[k1], offset[k2]);
+            std::swap(len[k1], len[k2]);
+        }
+
+        void swap(blocked_row& other) {
+            offset.swap(other.offset);
+            len.swap(other.len);
+            data.swap(other.data);
+            std::swap(dead, other.dead);
+        }
+
+        private:
+        vector<int> offset;
+        vector<int> len;
+        vector<int> data;
+        int dead = 0;
+
+        // 詰め直し先は全行で使い回し、入れ替えた古い配列を次の詰め直しに回す (定常状態ではヒープ確保しない)
+        void compact() {
+            static thread_local vector<int> packed;
+            packed.clear();
+            for (int k = 0; k < (int) offset.size(); k++) {
+                const int old = offset[k];
+                offset[k] = packed.size();
+                packed.insert(packed.end(), data.begin() + old, data.begin() + old + len[k]);
+            }
+            data.swap(packed);
+            dead = 0;
+        }
+    };
+};
+
+#endif //ICFPC2023_BLOCKED_LISTS_H
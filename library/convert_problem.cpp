@@ -0,0 +1,18 @@
+#include "problem.h"
+#include <iostream>
+
+using namespace std;
+
+// problems/*.json をバイナリ形式に変換する。変換したファイルは load_problem / load_problem_mmap でそのまま読める
+// c++ -std=c++17 -O3 convert_problem.cpp -o convert_problem
+// for i in $(seq 1 90); do ./convert_problem ../problems/$i.json ../problems/$i.bin; done
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        cout << "usage: " << argv[0] << " problem.json problem.bin" << endl;
+        return 0;
+    }
+    manarimo::problem_t problem;
+    manarimo::load_problem(argv[1], problem);
+    manarimo::save_problem_binary(argv[2], problem);
+    return 0;
+}
@@ -0,0 +1,158 @@
+#ifndef ICFPC2023_GEOMETRY_KERNELS_H
+#define ICFPC2023_GEOMETRY_KERNELS_H
+
+#include <cmath>
+#include <utility>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define MANARIMO_AVX2_KERNELS
+#endif
+
+// 遮蔽判定で使う角度計算をまとめて配列に対して行う
+// x86-64 では実行時に AVX2 の有無を見て 4 要素ずつ計算し、なければスカラーで計算する
+// どちらも同じ順序の IEEE 演算 (加減乗除と sqrt のみ) なので結果はビット単位で一致する
+namespace manarimo {
+    using namespace std;
+
+    // atan2(dy, dx) と同じ順序になる擬似角度。値域は (-2, 2] で、一周が 4
+    inline double pseudo_angle(double dx, double dy) {
+        double p = dx / (fabs(dx) + fabs(dy));
+        return dy < 0 ? p - 1 : 1 - p;
+    }
+
+    // 視点から (dx, dy) にある半径 r の円の2本の接線方向の擬似角度
+    // 境目をまたぐと end < start になる。視点が円の中にあると NaN
+    inline void tangent_angles(double dx, double dy, double r, double& start, double& end) {
+        double s = r / sqrt(dx * dx + dy * dy);
+        double c = sqrt(1 - s * s);
+        start = pseudo_angle(dx * c + dy * s, dy * c - dx * s);
+        end = pseudo_angle(dx * c - dy * s, dy * c + dx * s);
+    }
+
+#ifdef MANARIMO_AVX2_KERNELS
+    namespace kernels {
+        inline bool has_avx2() {
+            static const bool supported = __builtin_cpu_supports("avx2");
+            return supported;
+        }
+
+        __attribute__((target("avx2"))) inline __m256d pseudo_angle4(__m256d dx, __m256d dy) {
+            const __m256d sign = _mm256_set1_pd(-0.0);
+            const __m256d one = _mm256_set1_pd(1.0);
+            __m256d p = _mm256_div_pd(dx, _mm256_add_pd(_mm256_andnot_pd(sign, dx), _mm256_andnot_pd(sign, dy)));
+            __m256d negative = _mm256_cmp_pd(dy, _mm256_setzero_pd(), _CMP_LT_OQ);
+            return _mm256_blendv_pd(_mm256_sub_pd(one, p), _mm256_sub_pd(p, one), negative);
+        }
+
+        // [x0 y0 x1 y1] [x2 y2 x3 y3] を [x0 x1 x2 x3] [y0 y1 y2 y3] に並べ替える
+        __attribute__((target("avx2"))) inline void load_points4(const double* xys, __m256d& x, __m256d& y) {
+            __m256d a = _mm256_loadu_pd(xys);
+            __m256d b = _mm256_loadu_pd(xys + 4);
+            x = _mm256_permute4x64_pd(_mm256_unpacklo_pd(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+            y = _mm256_permute4x64_pd(_mm256_unpackhi_pd(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+        }
+
+        __attribute__((target("avx2"))) inline int pseudo_angles_avx2(const double* xs, const double* ys, int n, double cx, double cy, double* out) {
+            const __m256d vcx = _mm256_set1_pd(cx);
+            const __m256d vcy = _mm256_set1_pd(cy);
+            int i = 0;
+            for (; i + 4 <= n; i += 4) {
+                __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(xs + i), vcx);
+                __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(ys + i), vcy);
+                _mm256_storeu_pd(out + i, pseudo_angle4(dx, dy));
+            }
+            return i;
+        }
+
+        __attribute__((target("avx2"))) inline int pseudo_angles_indexed_avx2(const double* xs, const double* ys, const int* index, int n, double cx, double cy, double* out) {
+            const __m256d vcx = _mm256_set1_pd(cx);
+            const __m256d vcy = _mm256_set1_pd(cy);
+            // _mm256_i32gather_pd は未初期化のレジスタを元にするので -Wall で警告が出る。0 を元にしたマスク付きの gather で同じことをする
+            const __m256d zero = _mm256_setzero_pd();
+            const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+            int i = 0;
+            for (; i + 4 <= n; i += 4) {
+                __m128i idx = _mm_loadu_si128(reinterpret_cast<const __m128i*>(index + i));
+                __m256d dx = _mm256_sub_pd(_mm256_mask_i32gather_pd(zero, xs, idx, all, 8), vcx);
+                __m256d dy = _mm256_sub_pd(_mm256_mask_i32gather_pd(zero, ys, idx, all, 8), vcy);
+                _mm256_storeu_pd(out + i, pseudo_angle4(dx, dy));
+            }
+            return i;
+        }
+
+        __attribute__((target("avx2"))) inline int pseudo_angles_points_avx2(const double* xys, int n, double cx, double cy, double* out) {
+            const __m256d vcx = _mm256_set1_pd(cx);
+            const __m256d vcy = _mm256_set1_pd(cy);
+            int i = 0;
+            for (; i + 4 <= n; i += 4) {
+                __m256d x, y;
+                load_points4(xys + i * 2, x, y);
+                _mm256_storeu_pd(out + i, pseudo_angle4(_mm256_sub_pd(x, vcx), _mm256_sub_pd(y, vcy)));
+            }
+            return i;
+        }
+
+        __attribute__((target("avx2"))) inline int tangent_angles_avx2(const double* xys, int n, double cx, double cy, double r, double* start, double* end) {
+            const __m256d vcx = _mm256_set1_pd(cx);
+            const __m256d vcy = _mm256_set1_pd(cy);
+            const __m256d vr = _mm256_set1_pd(r);
+            const __m256d one = _mm256_set1_pd(1.0);
+            int i = 0;
+            for (; i + 4 <= n; i += 4) {
+                __m256d x, y;
+                load_points4(xys + i * 2, x, y);
+                __m256d dx = _mm256_sub_pd(x, vcx);
+                __m256d dy = _mm256_sub_pd(y, vcy);
+                __m256d s = _mm256_div_pd(vr, _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy))));
+                __m256d c = _mm256_sqrt_pd(_mm256_sub_pd(one, _mm256_mul_pd(s, s)));
+                __m256d dxc = _mm256_mul_pd(dx, c);
+                __m256d dys = _mm256_mul_pd(dy, s);
+                __m256d dyc = _mm256_mul_pd(dy, c);
+                __m256d dxs = _mm256_mul_pd(dx, s);
+                _mm256_storeu_pd(start + i, pseudo_angle4(_mm256_add_pd(dxc, dys), _mm256_sub_pd(dyc, dxs)));
+                _mm256_storeu_pd(end + i, pseudo_angle4(_mm256_sub_pd(dxc, dys), _mm256_add_pd(dyc, dxs)));
+            }
+            return i;
+        }
+    };
+#endif
+
+    // out[i] = (xs[i] - cx, ys[i] - cy) の擬似角度
+    inline void pseudo_angles(const double* xs, const double* ys, int n, double cx, double cy, double* out) {
+        int i = 0;
+#ifdef MANARIMO_AVX2_KERNELS
+        if (kernels::has_avx2()) i = kernels::pseudo_angles_avx2(xs, ys, n, cx, cy, out);
+#endif
+        for (; i < n; i++) out[i] = pseudo_angle(xs[i] - cx, ys[i] - cy);
+    }
+
+    // out[i] = (xs[index[i]] - cx, ys[index[i]] - cy) の擬似角度
+    inline void pseudo_angles(const double* xs, const double* ys, const int* index, int n, double cx, double cy, double* out) {
+        int i = 0;
+#ifdef MANARIMO_AVX2_KERNELS
+        if (kernels::has_avx2()) i = kernels::pseudo_angles_indexed_avx2(xs, ys, index, n, cx, cy, out);
+#endif
+        for (; i < n; i++) out[i] = pseudo_angle(xs[index[i]] - cx, ys[index[i]] - cy);
+    }
+
+    // out[i] = points[i] - (cx, cy) の擬似角度
+    inline void pseudo_angles(const pair<double, double>* points, int n, double cx, double cy, double* out) {
+        int i = 0;
+#ifdef MANARIMO_AVX2_KERNELS
+        if (kernels::has_avx2()) i = kernels::pseudo_angles_points_avx2(reinterpret_cast<const double*>(points), n, cx, cy, out);
+#endif
+        for (; i < n; i++) out[i] = pseudo_angle(points[i].first - cx, points[i].second - cy);
+    }
+
+    // (cx, cy) から見た、centers[i] を中心とする半径 r の円の接線方向 (tangent_angles と同じ)
+    inline void tangent_angles(const pair<double, double>* centers, int n, double cx, double cy, double r, double* start, double* end) {
+        int i = 0;
+#ifdef MANARIMO_AVX2_KERNELS
+        if (kernels::has_avx2()) i = kernels::tangent_angles_avx2(reinterpret_cast<const double*>(centers), n, cx, cy, r, start, end);
+#endif
+        for (; i < n; i++) tangent_angles(centers[i].first - cx, centers[i].second - cy, r, start[i], end[i]);
+    }
+};
+
+#endif //ICFPC2023_GEOMETRY_KERNELS_H
@@ -0,0 +1,287 @@
+#ifndef ICFPC2023_GREEDY_PLACER_H
+#define ICFPC2023_GREEDY_PLACER_H
+
+#include <vector>
+#include <queue>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include "geo.h"
+#include "scoring.h"
+
+namespace manarimo {
+    using namespace std;
+    using namespace geo;
+
+    // (left + ix, bottom + iy) (0 <= ix < n_columns, 0 <= iy < n_rows) の格子点から、評価値が最大の点を1つずつ選ぶ貪欲法
+    // 評価値は置いた演奏家が増えても増えない (遮蔽が増えるだけ) ものとし、前に計算した値を上界として遅延評価のヒープに積んでおく (CELF)
+    // ヒープの先頭が今の配置で計算した値なら、それが最大。古い値なら計算し直して積み直す。先頭に来なかった候補は計算し直さない
+    // 格子点は長方形のブロックにまとめて上界で積んでおく。今の配置での上界が先頭に来たブロックは縦横に半分ずつ分け、4 点以下になったら中の点を計算する
+    // 同点は (ix, iy) の辞書順で最小の点を選ぶので、ix, iy の二重ループで最初の最大を取るのと同じ結果になる
+    // 置いた点から距離 radius 未満の格子点はビットマップで使用済みにする
+    //
+    // 点とブロックにはそれぞれ uint64_t を state_words 個, block_state_words 個の状態を持たせられる
+    // 評価関数には前回書いた状態と、そのときに置いてあった演奏家の数 since を渡すので、それ以降に置いた演奏家の分だけ差分で計算し直せる
+    // since = -1 は初めての計算 (点の状態が max_state_bytes に収まらなかったときは state = nullptr のまま毎回 -1)
+    class greedy_placer {
+        public:
+        greedy_placer(double left, double bottom, int n_columns, int n_rows, int block, double radius, worker_pool& pool, int state_words = 0, int block_state_words = 0, size_t max_state_bytes = (size_t) 1 << 28)
+            : left(left), bottom(bottom), n_columns(n_columns), n_rows(n_rows), block(max(1, block)), radius(radius), pool(pool), state_words(state_words), block_state_words(block_state_words) {
+            used.assign(((size_t) n_columns * n_rows + 63) / 64, 0);
+            if (state_words > 0) {
+                slot_of.assign((size_t) n_columns * n_rows, -1);
+                max_slots = max_state_bytes / (sizeof(uint64_t) * state_words);
+            }
+        }
+
+        // bound(bx, by): 最初のブロック (格子点 [bx * block, (bx + 1) * block) x [by * block, (by + 1) * block)) の評価値の、どの配置でも成り立つ上界
+        template<class Bound>
+        void init(Bound bound) {
+            heap = decltype(heap)();
+            nodes.clear();
+            node_states.clear();
+            free_node_slots.clear();
+            for (int ix = 0; ix < n_columns; ix += block) {
+                for (int iy = 0; iy < n_rows; iy += block) {
+                    const int id = create_node(ix, iy, min(block, n_columns - ix), min(block, n_rows - iy));
+                    heap.push({bound(ix / block, iy / block), index_of(ix, iy), id, -1});
+                }
+            }
+        }
+
+        // 今の配置での最大の点を out に入れる。候補が残っていなければ false
+        // evaluate(p, state, since, worker): 点 p の今の配置での評価値
+        // refine(lower, upper, state, parent_state, since, worker): 格子点 [lower, upper] のブロックの今の配置での上界
+        //   since = -1 のとき state は未初期化で、parent_state は分ける前のブロックの状態 (最初のブロックなら nullptr)
+        // どちらも並列に呼ばれる
+        template<class Evaluate, class Refine>
+        bool next(Evaluate evaluate, Refine refine, P& out) {
+            return next_impl(evaluate, refine, true, out);
+        }
+
+        // ブロックの上界を配置に応じて詰めない版。先頭に来たブロックはすぐに中の点を計算する
+        template<class Evaluate>
+        bool next(Evaluate evaluate, P& out) {
+            auto no_refine = [](const P&, const P&, uint64_t*, const uint64_t*, int, int) { return 0.0; };
+            return next_impl(evaluate, no_refine, false, out);
+        }
+
+        // p (格子点) に置く
+        void place(const P& p) {
+            const int cx = (int) llround(p.first - left);
+            const int cy = (int) llround(p.second - bottom);
+            const int r = (int) ceil(radius);
+            for (int ix = max(0, cx - r); ix <= min(n_columns - 1, cx + r); ix++) {
+                for (int iy = max(0, cy - r); iy <= min(n_rows - 1, cy + r); iy++) {
+                    const double dx = ix - cx, dy = iy - cy;
+                    if (dx * dx + dy * dy < radius * radius) {
+                        mark_used(index_of(ix, iy));
+                        release(index_of(ix, iy));
+                    }
+                }
+            }
+            round++;
+        }
+
+        long long evaluation_count() const { return evaluations; }
+        long long refinement_count() const { return refinements; }
+
+        private:
+        struct entry {
+            double value;
+            int index;   // 点の番号 (ブロックなら先頭の点の番号)。同点ならこれが小さい方を先に出す
+            int node;    // ブロックなら番号、点なら -1
+            int round;   // 値を計算したときに置いてあった演奏家の数 (init で積んだブロックは -1)
+            bool operator<(const entry& other) const {
+                if (value != other.value) return value < other.value;
+                if (index != other.index) return index > other.index;
+                return node < other.node;
+            }
+        };
+
+        // 格子点 [ix, ix + width) x [iy, iy + height) のブロック
+        struct node {
+            int ix;
+            int iy;
+            int width;
+            int height;
+            int slot;    // 状態の番号
+            int round;   // 状態を書いたときの round (まだなら -1)
+        };
+
+        // 上界を計算し直すブロックと、分ける前のブロック (なければ -1)
+        struct node_task {
+            int node;
+            int parent;
+        };
+
+        const double left;
+        const double bottom;
+        const int n_columns;
+        const int n_rows;
+        const int block;
+        const double radius;
+        worker_pool& pool;
+        const int state_words;
+        const int block_state_words;
+        size_t max_slots = 0;
+        int round = 0;
+        long long evaluations = 0;
+        long long refinements = 0;
+        vector<uint64_t> used;
+        priority_queue<entry> heap;
+        vector<int> tasks;              // 計算し直す点
+        vector<node_task> node_tasks;   // 上界を計算し直すブロック
+        vector<int> split_nodes;        // 分けたブロック (子の計算が終わったら状態を返す)
+        vector<double> values;
+        vector<int> slots;
+        vector<int> slot_of;            // 点ごとの状態の番号 (なければ -1)
+        vector<int> slot_round;         // 状態を書いたときの round (まだなら -1)
+        vector<int> free_slots;
+        vector<uint64_t> states;
+        vector<node> nodes;
+        vector<uint64_t> node_states;
+        vector<int> free_node_slots;
+
+        template<class Evaluate, class Refine>
+        bool next_impl(Evaluate& evaluate, Refine& refine, bool refining, P& out) {
+            while (!heap.empty()) {
+                const entry top = heap.top();
+                if (top.node < 0 && is_used(top.index)) {
+                    heap.pop();
+                    continue;
+                }
+                if (top.node < 0 && top.round == round) {
+                    out = position(top.index);
+                    return true;
+                }
+                // 先頭から古い値をまとめて取り出し、並列に計算し直す
+                tasks.clear();
+                node_tasks.clear();
+                split_nodes.clear();
+                while (!heap.empty() && (int) (tasks.size() + node_tasks.size()) < pool.size() * 4) {
+                    const entry e = heap.top();
+                    if (e.node < 0 && !is_used(e.index) && e.round == round) break;
+                    heap.pop();
+                    if (e.node < 0) {
+                        if (!is_used(e.index)) tasks.push_back(e.index);
+                    } else if (refining && e.round != round) {
+                        node_tasks.push_back({e.node, -1});
+                    } else if (!refining || nodes[e.node].width * nodes[e.node].height <= 4) {
+                        expand(e.node);
+                        release_node(e.node);
+                    } else {
+                        split(e.node);
+                        split_nodes.push_back(e.node);
+                    }
+                }
+                const int n_tasks = tasks.size();
+                values.resize(n_tasks + node_tasks.size());
+                slots.resize(n_tasks);
+                for (int i = 0; i < n_tasks; i++) slots[i] = acquire(tasks[i]);
+                pool.run(values.size(), [&](int i, int worker) {
+                    if (i < n_tasks) {
+                        const int slot = slots[i];
+                        uint64_t* state = slot >= 0 ? &states[(size_t) slot * state_words] : nullptr;
+                        values[i] = evaluate(position(tasks[i]), state, slot >= 0 ? slot_round[slot] : -1, worker);
+                    } else {
+                        const node_task& task = node_tasks[i - n_tasks];
+                        const node& n = nodes[task.node];
+                        const P lower(left + n.ix, bottom + n.iy);
+                        const P upper(left + n.ix + n.width - 1, bottom + n.iy + n.height - 1);
+                        const uint64_t* parent_state = task.parent >= 0 ? node_state(nodes[task.parent].slot) : nullptr;
+                        values[i] = refine(lower, upper, node_state(n.slot), parent_state, n.round, worker);
+                    }
+                });
+                for (int slot : slots) if (slot >= 0) slot_round[slot] = round;
+                for (int n : split_nodes) release_node(n);
+                evaluations += n_tasks;
+                refinements += node_tasks.size();
+                for (int i = 0; i < n_tasks; i++) heap.push({values[i], tasks[i], -1, round});
+                for (int i = 0; i < (int) node_tasks.size(); i++) {
+                    node& n = nodes[node_tasks[i].node];
+                    n.round = round;
+                    heap.push({values[n_tasks + i], index_of(n.ix, n.iy), node_tasks[i].node, round});
+                }
+            }
+            return false;
+        }
+
+        int index_of(int ix, int iy) const { return ix * n_rows + iy; }
+        P position(int index) const { return P(left + index / n_rows, bottom + index % n_rows); }
+        bool is_used(int index) const { return used[index >> 6] >> (index & 63) & 1; }
+        void mark_used(int index) { used[index >> 6] |= 1ULL << (index & 63); }
+
+        // index の状態を用意する。持てなければ -1
+        int acquire(int index) {
+            if (state_words == 0) return -1;
+            if (slot_of[index] >= 0) return slot_of[index];
+            int slot;
+            if (!free_slots.empty()) {
+                slot = free_slots.back();
+                free_slots.pop_back();
+            } else if (slot_round.size() < max_slots) {
+                slot = slot_round.size();
+                slot_round.push_back(-1);
+                states.resize(states.size() + state_words);
+            } else {
+                return -1;
+            }
+            slot_round[slot] = -1;
+            slot_of[index] = slot;
+            return slot;
+        }
+
+        void release(int index) {
+            if (state_words == 0 || slot_of[index] < 0) return;
+            free_slots.push_back(slot_of[index]);
+            slot_of[index] = -1;
+        }
+
+        uint64_t* node_state(int slot) { return node_states.data() + (size_t) slot * block_state_words; }
+
+        int create_node(int ix, int iy, int width, int height) {
+            int slot = 0;
+            if (block_state_words > 0) {
+                if (!free_node_slots.empty()) {
+                    slot = free_node_slots.back();
+                    free_node_slots.pop_back();
+                } else {
+                    slot = node_states.size() / block_state_words;
+                    node_states.resize(node_states.size() + block_state_words);
+                }
+            }
+            nodes.push_back({ix, iy, width, height, slot, -1});
+            return nodes.size() - 1;
+        }
+
+        void release_node(int id) {
+            if (block_state_words > 0) free_node_slots.push_back(nodes[id].slot);
+        }
+
+        // 縦横それぞれ半分に分けたブロックを、親の状態から上界を計算する予定に入れる
+        void split(int id) {
+            const node n = nodes[id];
+            const int w0 = (n.width + 1) / 2, h0 = (n.height + 1) / 2;
+            for (int dx = 0; dx < 2; dx++) {
+                for (int dy = 0; dy < 2; dy++) {
+                    const int width = dx == 0 ? w0 : n.width - w0;
+                    const int height = dy == 0 ? h0 : n.height - h0;
+                    if (width == 0 || height == 0) continue;
+                    node_tasks.push_back({create_node(n.ix + dx * w0, n.iy + dy * h0, width, height), id});
+                }
+            }
+        }
+
+        void expand(int id) {
+            const node& n = nodes[id];
+            for (int ix = n.ix; ix < n.ix + n.width; ix++) {
+                for (int iy = n.iy; iy < n.iy + n.height; iy++) {
+                    if (!is_used(index_of(ix, iy))) tasks.push_back(index_of(ix, iy));
+                }
+            }
+        }
+    };
+};
+
+#endif //ICFPC2023_GREEDY_PLACER_H
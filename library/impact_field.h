@@ -0,0 +1,259 @@
+#ifndef ICFPC2023_IMPACT_FIELD_H
+#define ICFPC2023_IMPACT_FIELD_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+#include <thread>
+#include "problem.h"
+#include "scoring.h"
+#include "impact_kernels.h"
+
+namespace manarimo {
+    using namespace std;
+    using namespace geo;
+
+    // 遮蔽を無視したときの影響 (no_block_impact) をステージ上の格子で先に計算しておく
+    // value(k, p): 格子点の値の双線形補間。O(1)
+    // exact(k, p): その点での正確な値。O(A)
+    // cell_bound(k, cx, cy): 区画のどこに置いても exact がこれを超えない上界。正の好みは区画に一番近い点、負の好みは一番遠い点の距離で評価する
+    // 好みの行は楽器ごと (problem.tastes_by_instrument) でも、呼び出し側で作った行でもよい。行の中身はこのクラスの寿命の間保つこと
+    class impact_field {
+        public:
+        impact_field() {}
+
+        // 演奏家を置ける範囲 (ステージから radius だけ内側) を楽器ごとに計算する。spacing <= 0 なら default_spacing を使う
+        void build(const problem_t& problem, double spacing = 0, double radius = 10, int n_threads = thread::hardware_concurrency()) {
+            const vector<const double*> rows(problem.tastes_by_instrument.begin(), problem.tastes_by_instrument.end());
+            const double width = problem.stage_width - radius * 2;
+            const double height = problem.stage_height - radius * 2;
+            if (spacing <= 0) spacing = default_spacing(width, height, rows.size(), problem.attendees.size());
+            build(problem, rows, problem.stage_bottom_left.first + radius, problem.stage_bottom_left.second + radius, width, height, spacing, n_threads);
+        }
+
+        // [left, left + width] x [bottom, bottom + height] を一辺 spacing の区画に分けて、rows[k] それぞれについて計算する
+        void build(const problem_t& problem, const vector<const double*>& rows, double left, double bottom, double width, double height, double spacing, int n_threads = thread::hardware_concurrency()) {
+            setup(problem, rows, left, bottom, width, height, spacing);
+            const int n_attendee = problem.attendees.size();
+            const double* xs = problem.attendee_x_data;
+            const double* ys = problem.attendee_y_data;
+            const int n_row = taste_rows.size();
+            node_values.assign((size_t) n_row * (nx + 1) * (ny + 1), 0);
+            cell_bounds.assign((size_t) n_row * nx * ny, 0);
+
+            parallel_for(ny + 1, n_threads, [&](int j, int) {
+                for (int i = 0; i <= nx; i++) {
+                    for (int k = 0; k < n_row; k++) node_values[node_index(k, i, j)] = no_block_impact(xs, ys, n_attendee, left + i * spacing, bottom + j * spacing, taste_rows[k]);
+                }
+            });
+
+            const double inf = numeric_limits<double>::infinity();
+            parallel_for(ny, n_threads, [&](int j, int) {
+                vector<double> near2(n_attendee), far2(n_attendee);
+                const double y0 = bottom + j * spacing, y1 = y0 + spacing;
+                for (int i = 0; i < nx; i++) {
+                    const double x0 = left + i * spacing, x1 = x0 + spacing;
+                    for (int a = 0; a < n_attendee; a++) {
+                        const double near_x = max({0.0, x0 - xs[a], xs[a] - x1});
+                        const double near_y = max({0.0, y0 - ys[a], ys[a] - y1});
+                        const double far_x = max(fabs(xs[a] - x0), fabs(xs[a] - x1));
+                        const double far_y = max(fabs(ys[a] - y0), fabs(ys[a] - y1));
+                        near2[a] = near_x * near_x + near_y * near_y;
+                        far2[a] = far_x * far_x + far_y * far_y;
+                    }
+                    for (int k = 0; k < n_row; k++) {
+                        const double* tastes = taste_rows[k];
+                        double sum = 0;
+                        for (int a = 0; a < n_attendee; a++) {
+                            if (tastes[a] > 0 && near2[a] == 0) {
+                                sum = inf;
+                                break;
+                            }
+                            sum += ceil(1000000 * tastes[a] / (tastes[a] > 0 ? near2[a] : far2[a]));
+                        }
+                        cell_bounds[cell_index(k, i, j)] = sum;
+                    }
+                }
+            });
+        }
+
+        // filename があればそれを読み、なければ (または問題が違えば) 計算して filename に書く。filename が空なら計算するだけ
+        void load_or_build(const string& filename, const problem_t& problem, const vector<const double*>& rows, double left, double bottom, double width, double height, double spacing, int n_threads = thread::hardware_concurrency()) {
+            if (!filename.empty() && load(filename, problem, rows, left, bottom, width, height, spacing)) return;
+            build(problem, rows, left, bottom, width, height, spacing, n_threads);
+            if (!filename.empty()) save(filename);
+        }
+
+        void load_or_build(const string& filename, const problem_t& problem, double spacing = 0, double radius = 10, int n_threads = thread::hardware_concurrency()) {
+            const vector<const double*> rows(problem.tastes_by_instrument.begin(), problem.tastes_by_instrument.end());
+            const double width = problem.stage_width - radius * 2;
+            const double height = problem.stage_height - radius * 2;
+            if (spacing <= 0) spacing = default_spacing(width, height, rows.size(), problem.attendees.size());
+            load_or_build(filename, problem, rows, problem.stage_bottom_left.first + radius, problem.stage_bottom_left.second + radius, width, height, spacing, n_threads);
+        }
+
+        // 格子点の値の双線形補間。範囲外の点は一番近い範囲内の点で評価する
+        double value(int k, const P& p) const {
+            const double u = min((double) nx, max(0.0, (p.first - left) / spacing));
+            const double v = min((double) ny, max(0.0, (p.second - bottom) / spacing));
+            const int i = min(nx - 1, (int) u);
+            const int j = min(ny - 1, (int) v);
+            const double fu = u - i, fv = v - j;
+            const double v00 = node_values[node_index(k, i, j)], v10 = node_values[node_index(k, i + 1, j)];
+            const double v01 = node_values[node_index(k, i, j + 1)], v11 = node_values[node_index(k, i + 1, j + 1)];
+            return (v00 * (1 - fu) + v10 * fu) * (1 - fv) + (v01 * (1 - fu) + v11 * fu) * fv;
+        }
+
+        double exact(int k, const P& p) const {
+            return no_block_impact(problem->attendee_x_data, problem->attendee_y_data, problem->attendees.size(), p.first, p.second, taste_rows[k]);
+        }
+
+        // p から exact が増える方向へ step ずつ動き、動けなくなったら step を半分にする。step が min_step を下回ったら終わり
+        // valid(q) が false の点には動かない。格子点の value で当たりをつけたあとの詰めに使う
+        template<class F>
+        P refine(int k, P p, double step, double min_step, F valid) const {
+            static const int DX[8] = {1, 1, 0, -1, -1, -1, 0, 1};
+            static const int DY[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+            double current = exact(k, p);
+            for (; step >= min_step; step /= 2) {
+                for (bool moved = true; moved;) {
+                    moved = false;
+                    for (int d = 0; d < 8; d++) {
+                        const P q(p.first + DX[d] * step, p.second + DY[d] * step);
+                        if (!valid(q)) continue;
+                        const double score = exact(k, q);
+                        if (score > current) {
+                            current = score;
+                            p = q;
+                            moved = true;
+                        }
+                    }
+                }
+            }
+            return p;
+        }
+
+        // p を含む区画の上界
+        double upper_bound(int k, const P& p) const {
+            return cell_bound(k, column_of(p.first), row_of(p.second));
+        }
+
+        double cell_bound(int k, int cx, int cy) const { return cell_bounds[cell_index(k, cx, cy)]; }
+        double node_value(int k, int i, int j) const { return node_values[node_index(k, i, j)]; }
+        P node(int i, int j) const { return P(left + i * spacing, bottom + j * spacing); }
+
+        int cell_columns() const { return nx; }
+        int cell_rows() const { return ny; }
+        int column_of(double x) const { return min(nx - 1, max(0, (int) floor((x - left) / spacing))); }
+        int row_of(double y) const { return min(ny - 1, max(0, (int) floor((y - bottom) / spacing))); }
+
+        // 計算量 (区画数 x 行数 x 聴衆数) がおよそ budget になる間隔。細かすぎても粗すぎても意味がないので [1, 最大辺 / 4] に収める
+        static double default_spacing(double width, double height, int n_rows, int n_attendee, double budget = 5e7) {
+            const double cells = max(1.0, budget / ((double) max(1, n_rows) * max(1, n_attendee)));
+            return min(max(1.0, max(width, height) / 4), max(1.0, sqrt(max(1.0, width * height) / cells)));
+        }
+
+        bool save(const string& filename) const {
+            ofstream f(filename, ios::binary);
+            if (!f) return false;
+            const header h = make_header();
+            f.write(reinterpret_cast<const char*>(&h), sizeof(h));
+            f.write(reinterpret_cast<const char*>(node_values.data()), sizeof(double) * node_values.size());
+            f.write(reinterpret_cast<const char*>(cell_bounds.data()), sizeof(double) * cell_bounds.size());
+            return (bool) f;
+        }
+
+        // filename が同じ問題・行・格子で作ったものなら読んで true
+        bool load(const string& filename, const problem_t& problem, const vector<const double*>& rows, double left, double bottom, double width, double height, double spacing) {
+            ifstream f(filename, ios::binary);
+            if (!f) return false;
+            header h;
+            if (!f.read(reinterpret_cast<char*>(&h), sizeof(h))) return false;
+            setup(problem, rows, left, bottom, width, height, spacing);
+            const header expected = make_header();
+            if (memcmp(&h, &expected, sizeof(h)) != 0) return false;
+            node_values.resize((size_t) taste_rows.size() * (nx + 1) * (ny + 1));
+            cell_bounds.resize((size_t) taste_rows.size() * nx * ny);
+            f.read(reinterpret_cast<char*>(node_values.data()), sizeof(double) * node_values.size());
+            f.read(reinterpret_cast<char*>(cell_bounds.data()), sizeof(double) * cell_bounds.size());
+            return (bool) f;
+        }
+
+        private:
+        constexpr static uint64_t MAGIC = 0x31444c4549464d4eULL;  // "NMFIELD1"
+
+        struct header {
+            uint64_t magic;
+            uint64_t fingerprint;
+            int32_t n_rows;
+            int32_t nx;
+            int32_t ny;
+            int32_t n_attendee;
+            double left;
+            double bottom;
+            double spacing;
+        };
+
+        const problem_t* problem = nullptr;
+        vector<const double*> taste_rows;
+        double left = 0;
+        double bottom = 0;
+        double spacing = 1;
+        int nx = 1;
+        int ny = 1;
+        vector<double> node_values;
+        vector<double> cell_bounds;
+
+        size_t node_index(int k, int i, int j) const { return ((size_t) k * (ny + 1) + j) * (nx + 1) + i; }
+        size_t cell_index(int k, int i, int j) const { return ((size_t) k * ny + j) * nx + i; }
+
+        void setup(const problem_t& problem, const vector<const double*>& rows, double left, double bottom, double width, double height, double spacing) {
+            this->problem = &problem;
+            taste_rows = rows;
+            this->left = left;
+            this->bottom = bottom;
+            this->spacing = spacing;
+            nx = max(1, (int) ceil(width / spacing));
+            ny = max(1, (int) ceil(height / spacing));
+        }
+
+        // 聴衆の位置と好みの行から作る FNV-1a。キャッシュが別の問題のものでないかを見る
+        uint64_t fingerprint() const {
+            uint64_t hash = 0xcbf29ce484222325ULL;
+            auto feed = [&hash](const double* data, size_t n) {
+                const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+                for (size_t i = 0; i < n * sizeof(double); i++) {
+                    hash ^= bytes[i];
+                    hash *= 0x100000001b3ULL;
+                }
+            };
+            const size_t n_attendee = problem->attendees.size();
+            feed(problem->attendee_x_data, n_attendee);
+            feed(problem->attendee_y_data, n_attendee);
+            for (const double* row : taste_rows) feed(row, n_attendee);
+            return hash;
+        }
+
+        header make_header() const {
+            header h;
+            memset(&h, 0, sizeof(h));
+            h.magic = MAGIC;
+            h.fingerprint = fingerprint();
+            h.n_rows = taste_rows.size();
+            h.nx = nx;
+            h.ny = ny;
+            h.n_attendee = problem->attendees.size();
+            h.left = left;
+            h.bottom = bottom;
+            h.spacing = spacing;
+            return h;
+        }
+    };
+};
+
+#endif //ICFPC2023_IMPACT_FIELD_H
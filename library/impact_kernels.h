@@ -0,0 +1,73 @@
+#ifndef ICFPC2023_IMPACT_KERNELS_H
+#define ICFPC2023_IMPACT_KERNELS_H
+
+#include <cmath>
+#include "geometry_kernels.h"
+
+// 遮蔽を無視したときの、1つの位置から全聴衆への影響 ceil(1000000 * taste / d^2) の和
+// 聴衆の座標は SoA (problem.attendee_x_data / attendee_y_data)、好みは楽器ごとの行 (problem.tastes_by_instrument[k]) で受け取る
+// 1項ずつの計算はスカラー版と同じ順序の IEEE 演算で、各項は整数なので、足す順番が違っても和はビット単位で一致する
+namespace manarimo {
+    using namespace std;
+
+    inline double no_block_impact_term(double dx, double dy, double taste) {
+        return ceil(1000000 * taste / (dx * dx + dy * dy));
+    }
+
+#ifdef MANARIMO_AVX2_KERNELS
+    namespace kernels {
+        __attribute__((target("avx2"))) inline double horizontal_sum4(__m256d v) {
+            __m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+            return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+        }
+
+        // taste_rows[k] それぞれについて [0, 4 * (n / 4)) の和を out[k] に入れ、計算した個数を返す
+        // 距離の計算は楽器によらないので、聴衆 4 人分の 1000000 / d^2 の分母を1回だけ作る
+        template<int K>
+        __attribute__((target("avx2"))) inline int no_block_impacts_avx2(const double* xs, const double* ys, int n, double px, double py, const double* const* taste_rows, double* out) {
+            const __m256d vpx = _mm256_set1_pd(px);
+            const __m256d vpy = _mm256_set1_pd(py);
+            const __m256d million = _mm256_set1_pd(1000000);
+            __m256d sum[K];
+            for (int k = 0; k < K; k++) sum[k] = _mm256_setzero_pd();
+            int i = 0;
+            for (; i + 4 <= n; i += 4) {
+                __m256d dx = _mm256_sub_pd(vpx, _mm256_loadu_pd(xs + i));
+                __m256d dy = _mm256_sub_pd(vpy, _mm256_loadu_pd(ys + i));
+                __m256d d2 = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+                for (int k = 0; k < K; k++) {
+                    __m256d v = _mm256_div_pd(_mm256_mul_pd(million, _mm256_loadu_pd(taste_rows[k] + i)), d2);
+                    sum[k] = _mm256_add_pd(sum[k], _mm256_round_pd(v, _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC));
+                }
+            }
+            for (int k = 0; k < K; k++) out[k] = horizontal_sum4(sum[k]);
+            return i;
+        }
+    };
+#endif
+
+    // taste_rows[0..K) それぞれについて、(px, py) から全聴衆への影響の和を out[k] に入れる
+    // スワップのように同じ位置を複数の楽器で評価するときは、聴衆を1回走査するだけで済む
+    template<int K>
+    inline void no_block_impacts(const double* xs, const double* ys, int n, double px, double py, const double* const* taste_rows, double* out) {
+        int i = 0;
+        for (int k = 0; k < K; k++) out[k] = 0;
+#ifdef MANARIMO_AVX2_KERNELS
+        if (kernels::has_avx2()) i = kernels::no_block_impacts_avx2<K>(xs, ys, n, px, py, taste_rows, out);
+#endif
+        for (; i < n; i++) {
+            const double dx = px - xs[i];
+            const double dy = py - ys[i];
+            for (int k = 0; k < K; k++) out[k] += no_block_impact_term(dx, dy, taste_rows[k][i]);
+        }
+    }
+
+    // (px, py) にいる、好みの行が tastes の楽器の演奏家の影響の和
+    inline double no_block_impact(const double* xs, const double* ys, int n, double px, double py, const double* tastes) {
+        double out;
+        no_block_impacts<1>(xs, ys, n, px, py, &tastes, &out);
+        return out;
+    }
+};
+
+#endif //ICFPC2023_IMPACT_KERNELS_H
@@ -0,0 +1,385 @@
+#ifndef ICFPC2023_INCREMENTAL_SCORER_H
+#define ICFPC2023_INCREMENTAL_SCORER_H
+
+#include "problem.h"
+#include "blocked_lists.h"
+#include "angular_index.h"
+#include "spatial_grid.h"
+#include "pillar_index.h"
+#include "scoring.h"
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+#ifndef M_PI
+    #define M_PI 3.14159265358979323846
+#endif
+
+namespace manarimo {
+    using namespace std;
+    using namespace geo;
+
+    // SA 用の差分スコア計算。各ソルバーの calc_blocked_one / blocked_attendees / blocked_count と同じ状態を持つ
+    // スコアは各ソルバーの焼きなましの目的関数と同じで、演奏家ごとに ceil(max_volume * q * max(impact, 0)) を足したもの (volume は 0 か max_volume の最適な方)
+    // manarimo::score は聴衆ごとに ceil(volume * q * ceil(1000000 * taste / d^2)) を足すので、ceil の取り方の分だけ score() とは一致しない
+    // 正確な得点が要るときは exact_score() を使う
+    // 演奏家が他の演奏家の 10 以内に入らないこと・ステージ内にいることは呼び出し側で保証する (is_valid_position)
+    class incremental_scorer {
+        public:
+        constexpr static number RADIUS = 10;
+        constexpr static number BLOCK_RADIUS = 5;
+
+        incremental_scorer(const problem_t& problem, const vector<P>& placements, number max_volume = 10);
+
+        // 演奏家 m を p に動かしたときのスコアを返す。commit() か rollback() を呼ぶまで次の提案はできない
+        number propose_move(int m, const P& p);
+        // 演奏家 a と b の位置を入れ替えたときのスコアを返す
+        number propose_swap(int a, int b);
+        void commit();
+        void rollback();
+
+        number score() const { return current_score; }
+        const vector<P>& get_placements() const { return placements; }
+        // 現在の配置に対して score() を与える volume
+        vector<number> volumes() const;
+        // 現在の配置と volumes() での manarimo::score。O(M A log A) なので最後の確認に使う
+        long long exact_score(int n_threads = thread::hardware_concurrency()) const;
+        bool is_valid_position(int m, const P& p) const;
+        // 状態を作り直す。誤差の蓄積を消したいときや配置を丸ごと差し替えるときに使う
+        void reset(const vector<P>& placements);
+
+        private:
+        enum proposal_type { NONE, MOVE, SWAP };
+
+        const problem_t& problem;
+        const int n_musician;
+        const int n_attendee;
+        const number max_volume;
+        vector<vector<int>> instrument;
+        vector<P> placements;
+        // is_valid_position 用。placements と同じ位置を持つ
+        spatial_grid grid;
+        // calc_blocked_one で見る柱をステージの区画ごとに絞っておく
+        pillar_index pillars;
+
+        vector<angular_index> attendee_angles;
+        // blocked_attendees[i][k]: 演奏家 i から見て演奏家 k がブロックしている聴衆
+        vector<blocked_row> blocked_attendees;
+        // blocked_count[i * n_attendee + j]: 演奏家 i と聴衆 j の間にある演奏家と柱の数
+        vector<int> blocked_count;
+        vector<number> q;
+        vector<number> impact_sum;
+        number current_score;
+
+        proposal_type pending = NONE;
+        int pending_m1;
+        int pending_m2;
+        P pending_p;
+        number pending_score;
+        angular_index tmp_attendee_angles;
+        blocked_row tmp_blocked_attendees;
+        vector<int> tmp_blocked_count;
+        vector<pair<int, int>> new_blocked;
+        // 提案中に q / impact_sum が変わった演奏家。tmp_* は touched 以外では q / impact_sum と一致している
+        vector<number> tmp_q;
+        vector<number> tmp_impact_sum;
+        vector<int> touched;
+        vector<char> is_touched;
+
+        number one_score(const P& p, int attendee, int instrument) const {
+            const number dx = p.first - problem.attendee_x_data[attendee];
+            const number dy = p.second - problem.attendee_y_data[attendee];
+            return ceil(1000000 * problem.tastes_by_instrument[instrument][attendee] / (dx * dx + dy * dy));
+        }
+
+        number musician_score(number q, number impact) const {
+            return ceil(max_volume * q * max(impact, 0.0));
+        }
+
+        static number dist(const P& p1, const P& p2) {
+            return sqrt(d(p1, p2));
+        }
+
+        void touch(int i) {
+            if (is_touched[i]) return;
+            is_touched[i] = 1;
+            touched.push_back(i);
+        }
+
+        number touched_score_diff() const {
+            number diff = 0;
+            for (int i : touched) diff += musician_score(tmp_q[i], tmp_impact_sum[i]) - musician_score(q[i], impact_sum[i]);
+            return diff;
+        }
+
+        void calc_blocked_one(int musician, const P& p, angular_index& angles, const angular_index& previous, blocked_row& blocked, int* count) const;
+        void swap_musician_state(int m1, int m2);
+    };
+
+    incremental_scorer::incremental_scorer(const problem_t& problem, const vector<P>& placements, number max_volume) :
+        problem(problem), n_musician(problem.musicians.size()), n_attendee(problem.n_attendees()), max_volume(max_volume),
+        instrument(problem.n_instruments), attendee_angles(n_musician), blocked_attendees(n_musician, blocked_row(n_musician)),
+        blocked_count((size_t) n_musician * n_attendee), q(n_musician), impact_sum(n_musician),
+        tmp_blocked_attendees(n_musician), tmp_blocked_count(n_attendee), tmp_q(n_musician), tmp_impact_sum(n_musician), is_touched(n_musician, 0) {
+        for (int i = 0; i < n_musician; i++) instrument[problem.musicians[i]].push_back(i);
+        for (angular_index& index : attendee_angles) index.init(problem.attendee_x_data, problem.attendee_y_data, n_attendee);
+        tmp_attendee_angles.init(problem.attendee_x_data, problem.attendee_y_data, n_attendee);
+        pillars.build(problem);
+        grid.reset(problem.stage_bottom_left.first + RADIUS, problem.stage_bottom_left.second + RADIUS, problem.stage_width - RADIUS * 2, problem.stage_height - RADIUS * 2, RADIUS);
+        reset(placements);
+    }
+
+    void incremental_scorer::reset(const vector<P>& placements) {
+        pending = NONE;
+        this->placements = placements;
+        grid.build(placements);
+        for (int i = 0; i < n_musician; i++) {
+            calc_blocked_one(i, placements[i], attendee_angles[i], attendee_angles[i], blocked_attendees[i], &blocked_count[(size_t) i * n_attendee]);
+        }
+        current_score = 0;
+        for (int i = 0; i < n_musician; i++) {
+            q[i] = 1;
+            if (problem.playing_together) {
+                for (int j : instrument[problem.musicians[i]]) {
+                    if (i == j) continue;
+                    q[i] += 1 / dist(placements[i], placements[j]);
+                }
+            }
+            impact_sum[i] = 0;
+            const int* count = &blocked_count[(size_t) i * n_attendee];
+            for (int j = 0; j < n_attendee; j++) {
+                if (count[j] == 0) impact_sum[i] += one_score(placements[i], j, problem.musicians[i]);
+            }
+            tmp_q[i] = q[i];
+            tmp_impact_sum[i] = impact_sum[i];
+            current_score += musician_score(q[i], impact_sum[i]);
+        }
+    }
+
+    void incremental_scorer::calc_blocked_one(int musician, const P& p, angular_index& angles, const angular_index& previous, blocked_row& blocked, int* count) const {
+        angles.build_from(previous, p.first, p.second);
+
+        blocked.clear();
+        for (int i = 0; i < n_attendee; i++) count[i] = 0;
+        angles.for_each_blocked(placements.data(), n_musician, BLOCK_RADIUS, [&](int i, int attendee) {
+            if (i == musician) return;
+            blocked.push_back(i, attendee);
+            count[attendee]++;
+        });
+        for (int i : pillars.near(p)) {
+            const pillar_t& pillar = problem.pillars[i];
+            angles.for_each_blocked(pillar.center.first - p.first, pillar.center.second - p.second, pillar.radius, [&](int attendee) {
+                if (get_ratio(p, problem.attendees[attendee].pos, pillar.center) < 1) count[attendee]++;
+            });
+        }
+    }
+
+    number incremental_scorer::propose_move(int m, const P& next_p) {
+        const P& current_p = placements[m];
+        const int in = problem.musicians[m];
+        pending = MOVE;
+        pending_m1 = m;
+        pending_p = next_p;
+
+        if (problem.playing_together) {
+            touch(m);
+            tmp_q[m] = 1;
+            for (int musician : instrument[in]) {
+                if (musician == m) continue;
+                number new_dist = 1 / dist(next_p, placements[musician]);
+                touch(musician);
+                tmp_q[musician] = q[musician] - 1 / dist(current_p, placements[musician]) + new_dist;
+                tmp_q[m] += new_dist;
+            }
+        }
+
+        // m がいなくなることで見えるようになる聴衆
+        for (int i = 0; i < n_musician; i++) {
+            if (i == m) continue;
+            int* count = &blocked_count[(size_t) i * n_attendee];
+            for (int j : blocked_attendees[i][m]) {
+                count[j]--;
+                if (count[j] == 0) {
+                    touch(i);
+                    tmp_impact_sum[i] += one_score(placements[i], j, problem.musicians[i]);
+                }
+            }
+        }
+
+        // 移動先の m から見える聴衆
+        calc_blocked_one(m, next_p, tmp_attendee_angles, attendee_angles[m], tmp_blocked_attendees, tmp_blocked_count.data());
+        touch(m);
+        tmp_impact_sum[m] = 0;
+        for (int i = 0; i < n_attendee; i++) {
+            if (tmp_blocked_count[i] == 0) tmp_impact_sum[m] += one_score(next_p, i, in);
+        }
+
+        // 移動先の m にブロックされる聴衆
+        new_blocked.clear();
+        for (int i = 0; i < n_musician; i++) {
+            if (i == m) continue;
+            const int* count = &blocked_count[(size_t) i * n_attendee];
+            attendee_angles[i].for_each_blocked(next_p.first - placements[i].first, next_p.second - placements[i].second, BLOCK_RADIUS, [&](int attendee) {
+                new_blocked.emplace_back(i, attendee);
+                if (count[attendee] == 0) {
+                    touch(i);
+                    tmp_impact_sum[i] -= one_score(placements[i], attendee, problem.musicians[i]);
+                }
+            });
+        }
+
+        pending_score = current_score + touched_score_diff();
+        return pending_score;
+    }
+
+    number incremental_scorer::propose_swap(int m1, int m2) {
+        pending = SWAP;
+        pending_m1 = m1;
+        pending_m2 = m2;
+        const int in1 = problem.musicians[m1];
+        const int in2 = problem.musicians[m2];
+        if (in1 == in2) {
+            // 同じ楽器同士の入れ替えはスコアが変わらない
+            pending_score = current_score;
+            return pending_score;
+        }
+
+        const P& p1 = placements[m1];
+        const P& p2 = placements[m2];
+        if (problem.playing_together) {
+            touch(m1);
+            touch(m2);
+            tmp_q[m1] = tmp_q[m2] = 1;
+            for (int musician : instrument[in1]) {
+                if (musician == m1) continue;
+                number new_dist = 1 / dist(p2, placements[musician]);
+                touch(musician);
+                tmp_q[musician] = q[musician] - 1 / dist(p1, placements[musician]) + new_dist;
+                tmp_q[m1] += new_dist;
+            }
+            for (int musician : instrument[in2]) {
+                if (musician == m2) continue;
+                number new_dist = 1 / dist(p1, placements[musician]);
+                touch(musician);
+                tmp_q[musician] = q[musician] - 1 / dist(p2, placements[musician]) + new_dist;
+                tmp_q[m2] += new_dist;
+            }
+        }
+
+        // 見える聴衆は位置だけで決まるので、相手の blocked_count をそのまま使える
+        touch(m1);
+        touch(m2);
+        number is1 = 0, is2 = 0;
+        const int* count1 = &blocked_count[(size_t) m1 * n_attendee];
+        const int* count2 = &blocked_count[(size_t) m2 * n_attendee];
+        for (int i = 0; i < n_attendee; i++) {
+            if (count1[i] == 0) is2 += one_score(p1, i, in2);
+            if (count2[i] == 0) is1 += one_score(p2, i, in1);
+        }
+        tmp_impact_sum[m1] = is1;
+        tmp_impact_sum[m2] = is2;
+
+        pending_score = current_score + touched_score_diff();
+        return pending_score;
+    }
+
+    void incremental_scorer::swap_musician_state(int m1, int m2) {
+        swap(placements[m1], placements[m2]);
+        grid.swap_positions(m1, m2);
+        attendee_angles[m1].swap(attendee_angles[m2]);
+        blocked_attendees[m1].swap(blocked_attendees[m2]);
+        for (int i = 0; i < n_musician; i++) blocked_attendees[i].swap_columns(m1, m2);
+        swap_ranges(blocked_count.begin() + (size_t) m1 * n_attendee, blocked_count.begin() + (size_t) (m1 + 1) * n_attendee, blocked_count.begin() + (size_t) m2 * n_attendee);
+    }
+
+    void incremental_scorer::commit() {
+        if (pending == MOVE) {
+            const int m = pending_m1;
+            placements[m] = pending_p;
+            grid.move(m, pending_p);
+            attendee_angles[m].swap(tmp_attendee_angles);
+            blocked_attendees[m].swap(tmp_blocked_attendees);
+            copy(tmp_blocked_count.begin(), tmp_blocked_count.end(), blocked_count.begin() + (size_t) m * n_attendee);
+            for (int i = 0; i < n_musician; i++) {
+                if (i == m) continue;
+                blocked_attendees[i].clear(m);
+            }
+            for (const pair<int, int>& p : new_blocked) {
+                blocked_attendees[p.first].push_back(m, p.second);
+                blocked_count[(size_t) p.first * n_attendee + p.second]++;
+            }
+        } else if (pending == SWAP && problem.musicians[pending_m1] != problem.musicians[pending_m2]) {
+            swap_musician_state(pending_m1, pending_m2);
+        }
+        for (int i : touched) {
+            q[i] = tmp_q[i];
+            impact_sum[i] = tmp_impact_sum[i];
+            is_touched[i] = 0;
+        }
+        touched.clear();
+        if (pending != NONE) current_score = pending_score;
+        pending = NONE;
+    }
+
+    void incremental_scorer::rollback() {
+        if (pending == MOVE) {
+            const int m = pending_m1;
+            for (int i = 0; i < n_musician; i++) {
+                if (i == m) continue;
+                int* count = &blocked_count[(size_t) i * n_attendee];
+                for (int j : blocked_attendees[i][m]) count[j]++;
+            }
+        }
+        for (int i : touched) {
+            tmp_q[i] = q[i];
+            tmp_impact_sum[i] = impact_sum[i];
+            is_touched[i] = 0;
+        }
+        touched.clear();
+        pending = NONE;
+    }
+
+    vector<number> incremental_scorer::volumes() const {
+        vector<number> ret(n_musician);
+        for (int i = 0; i < n_musician; i++) ret[i] = impact_sum[i] > 0 ? max_volume : 0;
+        return ret;
+    }
+
+    long long incremental_scorer::exact_score(int n_threads) const {
+        return score_parallel(problem, solution_t(placements, volumes()), max(1, n_threads));
+    }
+
+    bool incremental_scorer::is_valid_position(int m, const P& p) const {
+        const number left = problem.stage_bottom_left.first + RADIUS;
+        const number bottom = problem.stage_bottom_left.second + RADIUS;
+        const number right = problem.stage_bottom_left.first + problem.stage_width - RADIUS;
+        const number top = problem.stage_bottom_left.second + problem.stage_height - RADIUS;
+        if (p.first < left || p.first > right || p.second < bottom || p.second > top) return false;
+        return !grid.collides(p, RADIUS * RADIUS, m);
+    }
+};
+
+/*
+int main() {
+    manarimo::problem_t problem;
+    manarimo::load_problem(std::cin, problem);
+    manarimo::incremental_scorer scorer(problem, initial_placements);
+    sa::simulated_annealing sa;
+    while (!sa.end()) {
+        double next_score;
+        if (move) {
+            if (!scorer.is_valid_position(m, p)) continue;
+            next_score = scorer.propose_move(m, p);
+        } else {
+            next_score = scorer.propose_swap(m1, m2);
+        }
+        if (sa.accept(scorer.score(), next_score)) {
+            scorer.commit();
+        } else {
+            scorer.rollback();
+        }
+    }
+    manarimo::print_solution(std::cout, scorer.get_placements(), scorer.volumes());
+}*/
+
+#endif //ICFPC2023_INCREMENTAL_SCORER_H
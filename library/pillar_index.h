@@ -0,0 +1,165 @@
+#ifndef ICFPC2023_PILLAR_INDEX_H
+#define ICFPC2023_PILLAR_INDEX_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "geo.h"
+#include "problem.h"
+
+namespace manarimo {
+    using namespace std;
+    using namespace geo;
+
+    // is_in_convex({a, b, c}, p) と同じ判定を、配列を作らずに行う
+    inline bool is_in_triangle(const P& a, const P& b, const P& c, const P& p) {
+        const number s1 = ccw(a, b, p), s2 = ccw(b, c, p), s3 = ccw(c, a, p);
+        return max({s1, s2, s3}) <= 0 || min({s1, s2, s3}) >= 0;
+    }
+
+    // 柱が聴衆とステージ上のどこかとの間に入りうるか (スコア計算で使う判定)
+    // stage_corners は 左下, 左上, 右下, 右上 の順
+    inline bool is_pillar_effective(const P& attendee, const P (&stage_corners)[4], const pillar_t& pillar) {
+        for (const auto& corner : stage_corners) {
+            if (dist_line(attendee, corner, pillar.center) < pillar.radius * pillar.radius) {
+                return true;
+            }
+        }
+        if (is_in_triangle(attendee, stage_corners[0], stage_corners[3], pillar.center)) {
+            return true;
+        }
+        if (is_in_triangle(attendee, stage_corners[1], stage_corners[2], pillar.center)) {
+            return true;
+        }
+        return false;
+    }
+
+    bool is_pillar_effective(const atendee_t& attendee, const P& stage_bottom_left, const number stage_width, const number stage_height, const pillar_t& pillar) {
+        const P stage_corners[4] = {
+            stage_bottom_left,
+            {stage_bottom_left.first, stage_bottom_left.second + stage_height},
+            {stage_bottom_left.first + stage_width, stage_bottom_left.second},
+            {stage_bottom_left.first + stage_width, stage_bottom_left.second + stage_height},
+        };
+        return is_pillar_effective(attendee.pos, stage_corners, pillar);
+    }
+
+    // 柱の絞り込みを問題の読み込み時に一度だけ計算しておく
+    // effective(attendee): is_pillar_effective が true になる柱 (スコア計算用)
+    // near(p): ステージを divisions x divisions に分けた区画のうち p を含む区画から、どれかの聴衆との間に入りうる柱
+    //          区画と聴衆の凸包に円が掛かるかで判定するので、区画内のどこから見ても取りこぼしはない
+    class pillar_index {
+        public:
+        struct segment {
+            const int* first;
+            const int* last;
+            const int* begin() const { return first; }
+            const int* end() const { return last; }
+            int size() const { return last - first; }
+            bool empty() const { return first == last; }
+        };
+
+        pillar_index() {}
+        explicit pillar_index(const problem_t& problem, int divisions = 8) {
+            build(problem, divisions);
+        }
+
+        void build(const problem_t& problem, int divisions = 8) {
+            const int n_attendee = problem.attendees.size();
+            const int n_pillar = problem.pillars.size();
+            const P bottom_left(problem.stage_bottom_left.first, problem.stage_bottom_left.second);
+            const P stage_corners[4] = {
+                bottom_left,
+                {bottom_left.first, bottom_left.second + problem.stage_height},
+                {bottom_left.first + problem.stage_width, bottom_left.second},
+                {bottom_left.first + problem.stage_width, bottom_left.second + problem.stage_height},
+            };
+
+            effective_offset.assign(n_attendee + 1, 0);
+            effective_ids.clear();
+            for (int i = 0; i < n_attendee; i++) {
+                for (int j = 0; j < n_pillar; j++) {
+                    if (is_pillar_effective(problem.attendees[i].pos, stage_corners, problem.pillars[j])) effective_ids.push_back(j);
+                }
+                effective_offset[i + 1] = effective_ids.size();
+            }
+
+            this->divisions = divisions;
+            left = bottom_left.first;
+            bottom = bottom_left.second;
+            cell_width = problem.stage_width / divisions;
+            cell_height = problem.stage_height / divisions;
+            // 区画は凸包ごとステージの凸包に含まれるので、ステージ全体で掛からない柱はどの区画でも掛からない
+            const P stage[4] = {stage_corners[0], stage_corners[2], stage_corners[3], stage_corners[1]};
+            vector<int> candidates;
+            for (int j = 0; j < n_pillar; j++) {
+                for (int i = 0; i < n_attendee; i++) {
+                    if (hull_touches(problem.attendees[i].pos, stage, problem.pillars[j])) {
+                        candidates.push_back(j);
+                        break;
+                    }
+                }
+            }
+            region_offset.assign(divisions * divisions + 1, 0);
+            region_ids.clear();
+            for (int r = 0; r < divisions * divisions; r++) {
+                const number x0 = left + cell_width * (r % divisions);
+                const number y0 = bottom + cell_height * (r / divisions);
+                // 反時計回り
+                const P region[4] = {{x0, y0}, {x0 + cell_width, y0}, {x0 + cell_width, y0 + cell_height}, {x0, y0 + cell_height}};
+                for (int j : candidates) {
+                    for (int i = 0; i < n_attendee; i++) {
+                        if (hull_touches(problem.attendees[i].pos, region, problem.pillars[j])) {
+                            region_ids.push_back(j);
+                            break;
+                        }
+                    }
+                }
+                region_offset[r + 1] = region_ids.size();
+            }
+        }
+
+        segment effective(int attendee) const {
+            return {effective_ids.data() + effective_offset[attendee], effective_ids.data() + effective_offset[attendee + 1]};
+        }
+
+        segment near(const P& p) const {
+            const int cx = min(divisions - 1, max(0, (int) floor((p.first - left) / cell_width)));
+            const int cy = min(divisions - 1, max(0, (int) floor((p.second - bottom) / cell_height)));
+            const int r = cy * divisions + cx;
+            return {region_ids.data() + region_offset[r], region_ids.data() + region_offset[r + 1]};
+        }
+
+        private:
+        vector<int> effective_offset;
+        vector<int> effective_ids;
+        int divisions = 1;
+        number left = 0;
+        number bottom = 0;
+        number cell_width = 1;
+        number cell_height = 1;
+        vector<int> region_offset;
+        vector<int> region_ids;
+
+        // 点 a と長方形 region の凸包に柱が掛かるか。凸包は長方形と、a と各辺を結んだ三角形の和
+        static bool hull_touches(const P& a, const P (&region)[4], const pillar_t& pillar) {
+            const P& c = pillar.center;
+            // 誤差で取りこぼさないよう少しだけ広げる
+            const number r = pillar.radius + 1e-6;
+            const number r2 = r * r;
+            // 凸包を囲む長方形に掛からなければ掛からない
+            if (c.first + r < min(a.first, region[0].first) || c.first - r > max(a.first, region[2].first)) return false;
+            if (c.second + r < min(a.second, region[0].second) || c.second - r > max(a.second, region[2].second)) return false;
+            if (c.first >= region[0].first && c.first <= region[2].first && c.second >= region[0].second && c.second <= region[2].second) return true;
+            for (int k = 0; k < 4; k++) {
+                const P& p = region[k];
+                const P& q = region[(k + 1) % 4];
+                if (dist_line(a, p, c) < r2 || dist_line(p, q, c) < r2) return true;
+                if (is_in_triangle(a, p, q, c)) return true;
+            }
+            return false;
+        }
+    };
+};
+
+#endif //ICFPC2023_PILLAR_INDEX_H
@@ -6,6 +6,19 @@
 #include <vector>
 #include <string>
 #include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 namespace manarimo {
     using namespace std;
@@ -18,12 +31,24 @@ namespace manarimo {
         number second;
     };
 
+    // problem_t::tastes の1行分を指す読み取り専用のビュー
+    struct taste_row {
+        const number* ptr = nullptr;
+        size_t n = 0;
+
+        const number& operator[](size_t i) const { return ptr[i]; }
+        size_t size() const { return n; }
+        const number* begin() const { return ptr; }
+        const number* end() const { return ptr + n; }
+    };
+
+    // 既存コード向けの互換ビュー。実データは problem_t の SoA 配列にある
     struct atendee_t {
         number x;
         number y;
         P pos;
         P get_pos() { return pos; }
-        vector<number> tastes;
+        taste_row tastes;
     };
 
     struct pillar_t {
@@ -33,17 +58,121 @@ namespace manarimo {
 
     struct problem_t {
         // 問題定義に書いてある情報
-        number room_width;
-        number room_height;
-        number stage_width;
-        number stage_height;
-        P2 stage_bottom_left;
+        number room_width = 0;
+        number room_height = 0;
+        number stage_width = 0;
+        number stage_height = 0;
+        P2 stage_bottom_left = {0, 0};
 
         vector<int> musicians;
-        vector<atendee_t> attendees;
         vector<pillar_t> pillars;
 
-        bool playing_together;
+        bool playing_together = false;
+
+        // 聴衆は SoA で持つ。tastes は attendees × instruments の row-major
+        vector<number> attendee_x;
+        vector<number> attendee_y;
+        vector<number> tastes;
+        int n_instruments = 0;
+
+        // tastes の転置 (instruments × attendees)。楽器ごとに聴衆を舐めるループが連続アクセスになる
+        vector<number> instrument_tastes;
+
+        // 実際に参照する配列。通常は上の vector を指すが、バイナリ形式を mmap したときはマップ領域を直接指す
+        int attendee_count = 0;
+        const number* attendee_x_data = nullptr;
+        const number* attendee_y_data = nullptr;
+        const number* taste_data = nullptr;
+        const number* instrument_taste_data = nullptr;
+        // mmap した領域など、*_data が指すメモリの持ち主
+        shared_ptr<const void> backing;
+
+        // tastes_by_instrument[instrument][attendee] で引けるように instrument_taste_data の各行を指す (init() で作る)
+        vector<const number*> tastes_by_instrument;
+
+        // attendee_x_data / attendee_y_data / taste_data を指す互換ビュー (init() で作る)
+        vector<atendee_t> attendees;
+
+        problem_t() {}
+        problem_t(const problem_t& other) { *this = other; }
+        problem_t(problem_t&& other) = default;
+        problem_t& operator=(problem_t&& other) = default;
+        problem_t& operator=(const problem_t& other) {
+            room_width = other.room_width;
+            room_height = other.room_height;
+            stage_width = other.stage_width;
+            stage_height = other.stage_height;
+            stage_bottom_left = other.stage_bottom_left;
+            musicians = other.musicians;
+            pillars = other.pillars;
+            playing_together = other.playing_together;
+            attendee_x = other.attendee_x;
+            attendee_y = other.attendee_y;
+            tastes = other.tastes;
+            instrument_tastes = other.instrument_tastes;
+            n_instruments = other.n_instruments;
+            attendee_count = other.attendee_count;
+            attendee_x_data = other.attendee_x_data;
+            attendee_y_data = other.attendee_y_data;
+            taste_data = other.taste_data;
+            instrument_taste_data = other.instrument_taste_data;
+            backing = other.backing;
+            // vector を指していた場合はコピー元のバッファを指してしまうので張り直す
+            init();
+            return *this;
+        }
+
+        int n_attendees() const { return attendee_count; }
+
+        number taste(int attendee, int instrument) const {
+            return taste_data[(size_t) attendee * n_instruments + instrument];
+        }
+
+        const number* taste_row_of(int attendee) const {
+            return taste_data + (size_t) attendee * n_instruments;
+        }
+
+        // SoA 配列 (または backing と *_data) を用意した後に呼ぶ
+        void init() {
+            if (!backing) {
+                attendee_count = attendee_x.size();
+                if ((int) attendee_y.size() != attendee_count) {
+                    throw runtime_error("attendee x/y count mismatch");
+                }
+                n_instruments = attendee_count == 0 ? 0 : tastes.size() / attendee_count;
+                if ((size_t) n_instruments * attendee_count != tastes.size()) {
+                    throw runtime_error("attendee tastes have different lengths");
+                }
+                attendee_x_data = attendee_x.data();
+                attendee_y_data = attendee_y.data();
+                taste_data = tastes.data();
+
+                if (instrument_tastes.size() != tastes.size()) {
+                    instrument_tastes.resize(tastes.size());
+                    for (int i = 0; i < attendee_count; i++) {
+                        for (int k = 0; k < n_instruments; k++) {
+                            instrument_tastes[(size_t) k * attendee_count + i] = tastes[(size_t) i * n_instruments + k];
+                        }
+                    }
+                }
+                instrument_taste_data = instrument_tastes.data();
+            }
+
+            tastes_by_instrument.resize(n_instruments);
+            for (int k = 0; k < n_instruments; k++) {
+                tastes_by_instrument[k] = instrument_taste_data + (size_t) k * attendee_count;
+            }
+
+            attendees.resize(attendee_count);
+            for (int i = 0; i < attendee_count; i++) {
+                atendee_t& a = attendees[i];
+                a.x = attendee_x_data[i];
+                a.y = attendee_y_data[i];
+                a.pos = P(a.x, a.y);
+                a.tastes.ptr = taste_row_of(i);
+                a.tastes.n = n_instruments;
+            }
+        }
     };
 
     void from_json(const json& j, P2& p) {
@@ -51,13 +180,6 @@ namespace manarimo {
         j.at(1).get_to(p.second);
     }
 
-    void from_json(const json& j, atendee_t& a) {
-        j.at("x").get_to(a.x);
-        j.at("y").get_to(a.y);
-        j.at("tastes").get_to(a.tastes);
-        a.pos = P(a.x, a.y);
-    }
-
     void from_json(const json& j, pillar_t& p) {
         j.at("center").get_to(p.center);
         j.at("radius").get_to(p.radius);
@@ -70,28 +192,331 @@ namespace manarimo {
         j.at("stage_height").get_to(p.stage_height);
         j.at("stage_bottom_left").get_to(p.stage_bottom_left);
         j.at("musicians").get_to(p.musicians);
-        j.at("attendees").get_to(p.attendees);
         j.at("pillars").get_to(p.pillars);
         if (j.count("playing_together")) {
             j.at("playing_together").get_to(p.playing_together);
         } else {
             p.playing_together = false;
         }
+
+        p.attendee_x.clear();
+        p.attendee_y.clear();
+        p.tastes.clear();
+        p.instrument_tastes.clear();
+        for (const json& a : j.at("attendees")) {
+            p.attendee_x.push_back(a.at("x").get<number>());
+            p.attendee_y.push_back(a.at("y").get<number>());
+            for (const json& t : a.at("tastes")) {
+                p.tastes.push_back(t.get<number>());
+            }
+        }
+        p.init();
+    }
+
+    // DOM を作らずに problem_t の SoA 配列へ直接書き込む SAX ハンドラ
+    class problem_sax_handler : public nlohmann::json_sax<json> {
+        public:
+        problem_sax_handler(problem_t& out) : out(out) {}
+
+        bool null() override { return true; }
+
+        bool boolean(bool val) override {
+            if (depth == 1 && top_key == "playing_together") out.playing_together = val;
+            return true;
+        }
+
+        bool number_integer(number_integer_t val) override { return on_number(val); }
+        bool number_unsigned(number_unsigned_t val) override { return on_number(val); }
+        bool number_float(number_float_t val, const string_t&) override { return on_number(val); }
+
+        bool string(string_t&) override { return true; }
+        bool binary(binary_t&) override { return true; }
+
+        bool start_object(size_t) override {
+            depth++;
+            if (depth == 3 && top_key == "pillars") out.pillars.push_back(pillar_t());
+            return true;
+        }
+
+        bool end_object() override {
+            depth--;
+            return true;
+        }
+
+        bool key(string_t& val) override {
+            if (depth == 1) top_key = val;
+            else if (depth == 3) inner_key = val;
+            return true;
+        }
+
+        bool start_array(size_t) override {
+            depth++;
+            index = 0;
+            return true;
+        }
+
+        bool end_array() override {
+            depth--;
+            return true;
+        }
+
+        // ex は基底クラスの参照なので、そのまま throw すると json::parse_error などで catch できなくなる。id から元の型に戻して投げる
+        bool parse_error(size_t, const std::string&, const nlohmann::detail::exception& ex) override {
+            switch (ex.id / 100) {
+                case 1: throw *static_cast<const json::parse_error*>(&ex);
+                case 2: throw *static_cast<const json::invalid_iterator*>(&ex);
+                case 3: throw *static_cast<const json::type_error*>(&ex);
+                case 4: throw *static_cast<const json::out_of_range*>(&ex);
+                case 5: throw *static_cast<const json::other_error*>(&ex);
+                default: throw runtime_error(ex.what());
+            }
+        }
+
+        private:
+        problem_t& out;
+        std::string top_key;
+        std::string inner_key;
+        int depth = 0;
+        int index = 0;
+
+        bool on_number(number val) {
+            switch (depth) {
+                case 1:
+                    if (top_key == "room_width") out.room_width = val;
+                    else if (top_key == "room_height") out.room_height = val;
+                    else if (top_key == "stage_width") out.stage_width = val;
+                    else if (top_key == "stage_height") out.stage_height = val;
+                    break;
+                case 2:
+                    if (top_key == "musicians") out.musicians.push_back(val);
+                    else if (top_key == "stage_bottom_left") (index++ == 0 ? out.stage_bottom_left.first : out.stage_bottom_left.second) = val;
+                    break;
+                case 3:
+                    if (top_key == "attendees") {
+                        if (inner_key == "x") out.attendee_x.push_back(val);
+                        else if (inner_key == "y") out.attendee_y.push_back(val);
+                    } else if (top_key == "pillars" && inner_key == "radius") {
+                        out.pillars.back().radius = val;
+                    }
+                    break;
+                case 4:
+                    if (top_key == "attendees" && inner_key == "tastes") out.tastes.push_back(val);
+                    else if (top_key == "pillars" && inner_key == "center") (index++ == 0 ? out.pillars.back().center.first : out.pillars.back().center.second) = val;
+                    break;
+            }
+            return true;
+        }
+    };
+
+    // バイナリ形式
+    // [header][musicians: int32 × M][attendee_x: double × A][attendee_y: double × A][tastes: double × A × I][tastes 転置: double × I × A][pillars: (x, y, r) double × P]
+    // 各セクションは 8 バイト境界に置くので、mmap した領域をそのまま double 配列として読める
+    const uint64_t PROBLEM_BIN_MAGIC = 0x31424f5250524e4dULL;  // "MNRPROB1"
+    const uint32_t PROBLEM_BIN_VERSION = 2;
+
+    struct problem_bin_header {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t playing_together;
+        uint32_t n_musician;
+        uint32_t n_attendee;
+        uint32_t n_instrument;
+        uint32_t n_pillar;
+        double room_width;
+        double room_height;
+        double stage_width;
+        double stage_height;
+        double stage_left;
+        double stage_bottom;
+        uint64_t musicians_offset;
+        uint64_t attendee_x_offset;
+        uint64_t attendee_y_offset;
+        uint64_t tastes_offset;
+        uint64_t instrument_tastes_offset;
+        uint64_t pillars_offset;
+        uint64_t total_size;
+    };
+
+    problem_bin_header make_problem_bin_header(const problem_t &problem) {
+        auto align = [](uint64_t offset) { return (offset + 7) & ~(uint64_t) 7; };
+        problem_bin_header h;
+        memset(&h, 0, sizeof(h));
+        h.magic = PROBLEM_BIN_MAGIC;
+        h.version = PROBLEM_BIN_VERSION;
+        h.playing_together = problem.playing_together;
+        h.n_musician = problem.musicians.size();
+        h.n_attendee = problem.n_attendees();
+        h.n_instrument = problem.n_instruments;
+        h.n_pillar = problem.pillars.size();
+        h.room_width = problem.room_width;
+        h.room_height = problem.room_height;
+        h.stage_width = problem.stage_width;
+        h.stage_height = problem.stage_height;
+        h.stage_left = problem.stage_bottom_left.first;
+        h.stage_bottom = problem.stage_bottom_left.second;
+        h.musicians_offset = align(sizeof(problem_bin_header));
+        h.attendee_x_offset = align(h.musicians_offset + sizeof(int32_t) * h.n_musician);
+        h.attendee_y_offset = h.attendee_x_offset + sizeof(double) * h.n_attendee;
+        h.tastes_offset = h.attendee_y_offset + sizeof(double) * h.n_attendee;
+        h.instrument_tastes_offset = h.tastes_offset + sizeof(double) * h.n_attendee * h.n_instrument;
+        h.pillars_offset = h.instrument_tastes_offset + sizeof(double) * h.n_attendee * h.n_instrument;
+        h.total_size = h.pillars_offset + sizeof(double) * 3 * h.n_pillar;
+        return h;
+    }
+
+    void save_problem_binary(ostream &f, const problem_t &problem) {
+        const problem_bin_header h = make_problem_bin_header(problem);
+        vector<char> buffer(h.total_size, 0);
+        memcpy(buffer.data(), &h, sizeof(h));
+        for (uint32_t i = 0; i < h.n_musician; i++) {
+            const int32_t m = problem.musicians[i];
+            memcpy(buffer.data() + h.musicians_offset + sizeof(int32_t) * i, &m, sizeof(m));
+        }
+        memcpy(buffer.data() + h.attendee_x_offset, problem.attendee_x_data, sizeof(double) * h.n_attendee);
+        memcpy(buffer.data() + h.attendee_y_offset, problem.attendee_y_data, sizeof(double) * h.n_attendee);
+        memcpy(buffer.data() + h.tastes_offset, problem.taste_data, sizeof(double) * h.n_attendee * h.n_instrument);
+        memcpy(buffer.data() + h.instrument_tastes_offset, problem.instrument_taste_data, sizeof(double) * h.n_attendee * h.n_instrument);
+        for (uint32_t i = 0; i < h.n_pillar; i++) {
+            const double pillar[3] = {problem.pillars[i].center.first, problem.pillars[i].center.second, problem.pillars[i].radius};
+            memcpy(buffer.data() + h.pillars_offset + sizeof(pillar) * i, pillar, sizeof(pillar));
+        }
+        f.write(buffer.data(), buffer.size());
+    }
+
+    void save_problem_binary(const string &filename, const problem_t &problem) {
+        ofstream f(filename, ios::binary);
+        save_problem_binary(f, problem);
+    }
+
+    // data から size バイトのバイナリ形式を読む。tastes などは data を直接指し、backing が data の寿命を持つ
+    void load_problem_binary(const char *data, size_t size, shared_ptr<const void> backing, problem_t &out) {
+        problem_bin_header h;
+        if (size < sizeof(h)) throw runtime_error("binary problem is truncated");
+        memcpy(&h, data, sizeof(h));
+        if (h.magic != PROBLEM_BIN_MAGIC || h.version != PROBLEM_BIN_VERSION) throw runtime_error("not a binary problem");
+        if (h.total_size > size) throw runtime_error("binary problem is truncated");
+        // 壊れたファイルや別の形式のファイルで範囲外を読まないよう、各セクションが size に収まり 8 バイト境界にあるかを見る
+        if (reinterpret_cast<uintptr_t>(data) % alignof(double) != 0) throw runtime_error("binary problem buffer is misaligned");
+        auto check_section = [&](uint64_t offset, uint64_t count, uint64_t element_size, uint64_t alignment) {
+            if (offset % alignment != 0) throw runtime_error("binary problem section is misaligned");
+            if (element_size != 0 && count > (numeric_limits<uint64_t>::max() - offset) / element_size) throw runtime_error("binary problem section overflows");
+            if (offset > size || offset + count * element_size > size) throw runtime_error("binary problem section is out of range");
+        };
+        const uint64_t n_tastes = (uint64_t) h.n_attendee * h.n_instrument;
+        check_section(h.musicians_offset, h.n_musician, sizeof(int32_t), sizeof(int32_t));
+        check_section(h.attendee_x_offset, h.n_attendee, sizeof(double), sizeof(double));
+        check_section(h.attendee_y_offset, h.n_attendee, sizeof(double), sizeof(double));
+        check_section(h.tastes_offset, n_tastes, sizeof(double), sizeof(double));
+        check_section(h.instrument_tastes_offset, n_tastes, sizeof(double), sizeof(double));
+        check_section(h.pillars_offset, h.n_pillar, sizeof(double) * 3, sizeof(double));
+        for (uint32_t i = 0; i < h.n_musician; i++) {
+            int32_t m;
+            memcpy(&m, data + h.musicians_offset + sizeof(int32_t) * i, sizeof(m));
+            if (m < 0 || (uint32_t) m >= h.n_instrument) throw runtime_error("binary problem has an invalid instrument");
+        }
+
+        out = problem_t();
+        out.room_width = h.room_width;
+        out.room_height = h.room_height;
+        out.stage_width = h.stage_width;
+        out.stage_height = h.stage_height;
+        out.stage_bottom_left = {h.stage_left, h.stage_bottom};
+        out.playing_together = h.playing_together;
+
+        out.musicians.resize(h.n_musician);
+        for (uint32_t i = 0; i < h.n_musician; i++) {
+            int32_t m;
+            memcpy(&m, data + h.musicians_offset + sizeof(int32_t) * i, sizeof(m));
+            out.musicians[i] = m;
+        }
+        out.pillars.resize(h.n_pillar);
+        for (uint32_t i = 0; i < h.n_pillar; i++) {
+            double pillar[3];
+            memcpy(pillar, data + h.pillars_offset + sizeof(pillar) * i, sizeof(pillar));
+            out.pillars[i].center = P(pillar[0], pillar[1]);
+            out.pillars[i].radius = pillar[2];
+        }
+
+        out.attendee_count = h.n_attendee;
+        out.n_instruments = h.n_instrument;
+        out.attendee_x_data = reinterpret_cast<const number*>(data + h.attendee_x_offset);
+        out.attendee_y_data = reinterpret_cast<const number*>(data + h.attendee_y_offset);
+        out.taste_data = reinterpret_cast<const number*>(data + h.tastes_offset);
+        out.instrument_taste_data = reinterpret_cast<const number*>(data + h.instrument_tastes_offset);
+        out.backing = std::move(backing);
+        out.init();
+    }
+
+    bool is_problem_binary(const char *data, size_t size) {
+        uint64_t magic;
+        if (size < sizeof(magic)) return false;
+        memcpy(&magic, data, sizeof(magic));
+        return magic == PROBLEM_BIN_MAGIC;
+    }
+
+    // fd を読み取り専用で mmap して読む。同じファイルを読むプロセス同士でページキャッシュを共有できる
+    // mmap が使えない環境・ファイルでは false を返す
+    bool load_problem_mmap(int fd, problem_t &out) {
+#if defined(__unix__) || defined(__APPLE__)
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < (off_t) sizeof(problem_bin_header)) return false;
+        const size_t size = st.st_size;
+        void *addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) return false;
+        shared_ptr<const void> mapping(addr, [size](const void *p) { munmap(const_cast<void*>(p), size); });
+        if (!is_problem_binary(static_cast<const char*>(addr), size)) return false;
+        load_problem_binary(static_cast<const char*>(addr), size, mapping, out);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void load_problem_mmap(const string &filename, problem_t &out) {
+#if defined(__unix__) || defined(__APPLE__)
+        const int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) throw runtime_error("cannot open " + filename);
+        // mmap は fd を閉じても残る
+        const bool ok = load_problem_mmap(fd, out);
+        close(fd);
+        if (ok) return;
+#endif
+        ifstream f(filename, ios::binary);
+        auto content = make_shared<std::string>((istreambuf_iterator<char>(f)), istreambuf_iterator<char>());
+        load_problem_binary(content->data(), content->size(), content, out);
     }
 
     // problem_t が大きすぎて json::get<> で読むとスタックオーバーフローするので、出力先は引数で取る
+    // JSON とバイナリ形式のどちらも読める。cin がバイナリ形式のファイルにリダイレクトされていれば mmap する
     void load_problem(istream &f, problem_t &out) {
-        json j;
-        f >> j;
-        from_json(j, out);
+        if (f.peek() == (PROBLEM_BIN_MAGIC & 0xff)) {
+#if defined(__unix__) || defined(__APPLE__)
+            if (&f == &cin && load_problem_mmap(STDIN_FILENO, out)) return;
+#endif
+            auto content = make_shared<std::string>((istreambuf_iterator<char>(f)), istreambuf_iterator<char>());
+            load_problem_binary(content->data(), content->size(), content, out);
+            return;
+        }
+
+        out = problem_t();
+        out.playing_together = false;
 
-        // out.init();
+        // istream から1文字ずつ読むと遅いので、まとめて読んでから SAX で流す
+        const std::string content((istreambuf_iterator<char>(f)), istreambuf_iterator<char>());
+        problem_sax_handler handler(out);
+        json::sax_parse(content, &handler);
+
+        out.init();
     }
 
     void load_problem(const string &filename, problem_t &out) {
-        ifstream f(filename);
+        ifstream f(filename, ios::binary);
+        if (f.peek() == (PROBLEM_BIN_MAGIC & 0xff)) {
+            f.close();
+            return load_problem_mmap(filename, out);
+        }
         return load_problem(f, out);
     }
 };
 
-#endif //ICFPC2023_PROBLEM_H
\ No newline at end of file
+#endif //ICFPC2023_PROBLEM_H
@@ -0,0 +1,181 @@
+#ifndef ICFPC2023_RNG_H
+#define ICFPC2023_RNG_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+namespace manarimo {
+    using namespace std;
+
+    class rng_batch;
+
+    // xoshiro256** 。状態はインスタンスごとに持つので、スレッドごと・レプリカごとに別の系列を持てる
+    // jump() で 2^128 個先に飛べるので、同じ seed から重ならない系列を作れる
+    class rng {
+        public:
+        explicit rng(uint64_t seed = DEFAULT_SEED) {
+            this->seed(seed);
+        }
+
+        // splitmix64 で状態を埋める
+        void seed(uint64_t seed) {
+            for (int i = 0; i < 4; i++) {
+                seed += 0x9e3779b97f4a7c15ULL;
+                uint64_t z = seed;
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+                s[i] = z ^ (z >> 31);
+            }
+        }
+
+        inline uint64_t next() {
+            const uint64_t result = rotl(s[1] * 5, 7) * 9;
+            const uint64_t t = s[1] << 17;
+            s[2] ^= s[0];
+            s[3] ^= s[1];
+            s[1] ^= s[2];
+            s[0] ^= s[3];
+            s[2] ^= t;
+            s[3] = rotl(s[3], 45);
+            return result;
+        }
+
+        inline uint32_t next_u32() {
+            return next() >> 32;
+        }
+
+        // [0, x)
+        inline unsigned get(unsigned x) {
+            return ((unsigned long long) next_u32() * x) >> 32;
+        }
+
+        // [x, y]
+        inline unsigned get(unsigned x, unsigned y) {
+            return get(y - x + 1) + x;
+        }
+
+        // [0, x] (x = 2^c - 1)
+        inline unsigned get_fast(unsigned x) {
+            return next_u32() & x;
+        }
+
+        // (0.0, 1.0)。0 を返さないので log にそのまま渡せる
+        inline double probability() {
+            return to_probability(next());
+        }
+
+        static inline double to_probability(uint64_t x) {
+            return ((x >> 11) + 0.5) * 0x1.0p-53;
+        }
+
+        inline double get_double(double x, double y) {
+            return probability() * (y - x) + x;
+        }
+
+        inline bool toss() {
+            return next() >> 63;
+        }
+
+        // 2^128 回 next() を呼んだのと同じ状態に進める
+        void jump() {
+            static const uint64_t JUMP[] = {0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL};
+            uint64_t t[4] = {0, 0, 0, 0};
+            for (uint64_t jump : JUMP) {
+                for (int b = 0; b < 64; b++) {
+                    if (jump & (1ULL << b)) {
+                        for (int i = 0; i < 4; i++) t[i] ^= s[i];
+                    }
+                    next();
+                }
+            }
+            for (int i = 0; i < 4; i++) s[i] = t[i];
+        }
+
+        // 今の系列から独立した系列を切り出す。自分は 2^128 個先に進む
+        rng split() {
+            rng child = *this;
+            jump();
+            return child;
+        }
+
+        constexpr static uint64_t DEFAULT_SEED = 88172645463325252ULL;
+
+        private:
+        friend class rng_batch;
+        uint64_t s[4];
+
+        static inline uint64_t rotl(const uint64_t x, int k) {
+            return (x << k) | (x >> (64 - k));
+        }
+    };
+
+    // jump で離した 4 本の xoshiro256** を並べて回し、乱数をまとめて作る
+    // 乗算を shift と add に直してあるので、各レーンの計算はコンパイラがベクトル化できる
+    class rng_batch {
+        public:
+        explicit rng_batch(uint64_t seed = rng::DEFAULT_SEED) {
+            rng base(seed);
+            for (int lane = 0; lane < LANES; lane++) {
+                rng r = base.split();
+                for (int i = 0; i < 4; i++) s[i][lane] = r.s[i];
+            }
+        }
+
+        // out[0..n) に (0.0, 1.0) の一様乱数を入れる
+        void fill_probability(double* out, int n) {
+            uint64_t buf[LANES];
+            int i = 0;
+            for (; i + LANES <= n; i += LANES) {
+                next(buf);
+                for (int lane = 0; lane < LANES; lane++) out[i + lane] = rng::to_probability(buf[lane]);
+            }
+            if (i < n) {
+                next(buf);
+                for (int lane = 0; i < n; lane++, i++) out[i] = rng::to_probability(buf[lane]);
+            }
+        }
+
+        // out[0..n) に [0, x) の一様乱数を入れる
+        void fill_int(unsigned* out, int n, unsigned x) {
+            uint64_t buf[LANES];
+            int i = 0;
+            for (; i + LANES <= n; i += LANES) {
+                next(buf);
+                for (int lane = 0; lane < LANES; lane++) out[i + lane] = ((buf[lane] >> 32) * x) >> 32;
+            }
+            if (i < n) {
+                next(buf);
+                for (int lane = 0; i < n; lane++, i++) out[i] = ((buf[lane] >> 32) * x) >> 32;
+            }
+        }
+
+        private:
+        constexpr static int LANES = 4;
+        alignas(32) uint64_t s[4][LANES];
+
+        inline void next(uint64_t* out) {
+            for (int lane = 0; lane < LANES; lane++) {
+                // rotl(s1 * 5, 7) * 9
+                uint64_t x = (s[1][lane] << 2) + s[1][lane];
+                x = (x << 7) | (x >> 57);
+                out[lane] = (x << 3) + x;
+                const uint64_t t = s[1][lane] << 17;
+                s[2][lane] ^= s[0][lane];
+                s[3][lane] ^= s[1][lane];
+                s[1][lane] ^= s[2][lane];
+                s[0][lane] ^= s[3][lane];
+                s[2][lane] ^= t;
+                s[3][lane] = (s[3][lane] << 45) | (s[3][lane] >> 19);
+            }
+        }
+    };
+
+    // 環境変数 SEED (なければ fallback) を seed にする。実験を再現するときは SEED を固定して走らせる
+    inline uint64_t seed_from_env(uint64_t fallback = rng::DEFAULT_SEED) {
+        const char* value = getenv("SEED");
+        return value != nullptr ? stoull(value) : fallback;
+    }
+};
+
+#endif //ICFPC2023_RNG_H
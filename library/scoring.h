@@ -3,12 +3,21 @@
 
 #include "problem.h"
 #include "solution.h"
+#include "geometry_kernels.h"
+#include "pillar_index.h"
 #include <vector>
 #include <set>
 #include <algorithm>
 #include <complex>
 #include <cmath>
 #include <iostream>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
 namespace manarimo {
     using namespace std;
     using namespace geo;
@@ -54,30 +63,8 @@ namespace manarimo {
         return angle;
     }
 
-    bool is_pillar_effective(const atendee_t& attendee, const P& stage_bottom_left, const number stage_width, const number stage_height, const pillar_t& pillar) {
-        // maybe a good idea to cache result
-        vector<P> stage_corners;
-        stage_corners.push_back(stage_bottom_left);
-        stage_corners.push_back({stage_bottom_left.first, stage_bottom_left.second + stage_height});
-        stage_corners.push_back({stage_bottom_left.first + stage_width, stage_bottom_left.second});
-        stage_corners.push_back({stage_bottom_left.first + stage_width, stage_bottom_left.second + stage_height});
-
-        for (const auto& corner : stage_corners) {
-            if (dist_line(attendee.pos, corner, pillar.center) < pillar.radius * pillar.radius) {
-                return true;
-            }
-        }
-
-        if (is_in_convex({attendee.pos, stage_corners[0], stage_corners[3]}, pillar.center)) {
-            return true;
-        }
-        if (is_in_convex({attendee.pos, stage_corners[1], stage_corners[2]}, pillar.center)) {
-            return true;
-        }
-        return false;
-    }
-
-    vector<int> get_unblocked_musician_of_attendee(const problem_t& problem, const vector<P>& placements, const int attendee_id) {
+    // pillars を渡すと、is_pillar_effective の結果を毎回計算せずに pillars.effective(attendee_id) を使う
+    vector<int> get_unblocked_musician_of_attendee(const problem_t& problem, const vector<P>& placements, const int attendee_id, const pillar_index* pillars = nullptr) {
         // only considers musician-pillar-attendee blocking.
         const int n_musician = problem.musicians.size();
         const int n_pillar = problem.pillars.size();
@@ -92,26 +79,32 @@ namespace manarimo {
         vector<event> event_infos;
         vector<pair<number, int>> events;
         // add event type=1
+        // 角度は atan2 と同じ順序になる擬似角度 (geometry_kernels.h) で比べる
+        vector<number> musician_angles(n_musician);
+        pseudo_angles(placements.data(), n_musician, center.real(), center.imag(), musician_angles.data());
         for (int i_musician = 0; i_musician < n_musician; i_musician++) {
-            const cP musician_position = {placements[i_musician].first, placements[i_musician].second};
-            const number argument = arg(musician_position - center);
-            events.emplace_back(argument, event_infos.size());
+            events.emplace_back(musician_angles[i_musician], event_infos.size());
             event_infos.push_back({1, i_musician});
         }
 
         // add event type=0, 2
         int overlapping_spans = 0;
-        for (int i_pillar = 0; i_pillar < n_pillar; i_pillar++) {
-            if (!is_pillar_effective(
-                problem.attendees[attendee_id], 
-                {problem.stage_bottom_left.first, problem.stage_bottom_left.second}, 
-                problem.stage_width, 
-                problem.stage_height, 
-                problem.pillars[i_pillar]
-            )) {
-                continue;
+        vector<int> effective_pillars;
+        if (pillars == nullptr) {
+            for (int i_pillar = 0; i_pillar < n_pillar; i_pillar++) {
+                if (is_pillar_effective(
+                    problem.attendees[attendee_id], 
+                    {problem.stage_bottom_left.first, problem.stage_bottom_left.second}, 
+                    problem.stage_width, 
+                    problem.stage_height, 
+                    problem.pillars[i_pillar]
+                )) {
+                    effective_pillars.push_back(i_pillar);
+                }
             }
-
+        }
+        const pillar_index::segment effective = pillars != nullptr ? pillars->effective(attendee_id) : pillar_index::segment{effective_pillars.data(), effective_pillars.data() + effective_pillars.size()};
+        for (const int i_pillar : effective) {
             const number pillar_radius = problem.pillars[i_pillar].radius;
             const cP location = {problem.pillars[i_pillar].center.first, problem.pillars[i_pillar].center.second};
             const cP vec = location - center;
@@ -119,11 +112,8 @@ namespace manarimo {
             if (distance < pillar_radius) {
                 return {};
             }
-            const number vec_argument = arg(vec);
-            const number offset = asin(pillar_radius / distance);
-
-            const number start = normalize_angle(vec_argument - offset);
-            const number end = normalize_angle(vec_argument + offset);
+            number start, end;
+            tangent_angles(vec.real(), vec.imag(), pillar_radius, start, end);
             if (start > end) {
                 overlapping_spans += 1;
             }
@@ -170,30 +160,25 @@ namespace manarimo {
         vector<event> event_infos;
         vector<pair<number, int>> events;
         // add event type=1
+        vector<number> attendee_angles(n_attendee);
+        pseudo_angles(problem.attendee_x_data, problem.attendee_y_data, n_attendee, center.real(), center.imag(), attendee_angles.data());
         for (int i_attendee = 0; i_attendee < n_attendee; i_attendee++) {
-            const auto& attendee = problem.attendees[i_attendee];
-            const cP attendee_position = {attendee.x, attendee.y};
-            const number argument = arg(attendee_position - center);
-            events.emplace_back(argument, event_infos.size());
+            events.emplace_back(attendee_angles[i_attendee], event_infos.size());
             event_infos.push_back({1, i_attendee});
         }
 
         // add event type=0, 2
         // assuming that musician distance is at least 10 (> 5)
         int overlapping_spans = 0;
+        const number block_distance = 5;
+        vector<number> starts(n_musician), ends(n_musician);
+        tangent_angles(placements.data(), n_musician, center.real(), center.imag(), block_distance, starts.data(), ends.data());
         for (int j_musician = 0; j_musician < n_musician; j_musician++) {
             if (j_musician == musician_id) {
                 continue;
             }
-            const number block_distance = 5;
-            const cP location = {placements[j_musician].first, placements[j_musician].second};
-            const cP vec = location - center;
-            const number distance = abs(vec);
-            const number vec_argument = arg(vec);
-            const number offset = asin(block_distance / distance);
-
-            const number start = normalize_angle(vec_argument - offset);
-            const number end = normalize_angle(vec_argument + offset);
+            const number start = starts[j_musician];
+            const number end = ends[j_musician];
             if (start > end) {
                 overlapping_spans += 1;
             }
@@ -225,47 +210,169 @@ namespace manarimo {
         return unblocked_attendees;
     }
     
-    vector<pair<int, int>> get_unblocked_pairs(const problem_t& problem, const vector<P>& placements) {
-        const int n_musician = problem.musicians.size();
-        const int n_attendee = problem.attendees.size();
-        
-        vector<pair<int, int>> musician_unblocked_pairs;
-        for (int i_musician = 0; i_musician < n_musician; i_musician++) {
-            for (auto i_attendee: get_unblocked_attendees_of_musician(
-                problem, placements, i_musician
-            )) {
-                musician_unblocked_pairs.emplace_back(i_musician, i_attendee);
+    // f(0), ..., f(n - 1) を n_threads 本のスレッドで分担して呼ぶ。f(i) は worker id も受け取る
+    template <class F>
+    void parallel_for(const int n, int n_threads, const F& f) {
+        n_threads = max(1, min(n_threads, n));
+        if (n_threads == 1) {
+            for (int i = 0; i < n; i++) f(i, 0);
+            return;
+        }
+        atomic<int> next(0);
+        vector<thread> workers;
+        for (int t = 0; t < n_threads; t++) {
+            workers.emplace_back([&, t]() {
+                for (int i = next++; i < n; i = next++) f(i, t);
+            });
+        }
+        for (auto& worker : workers) worker.join();
+    }
+
+    // parallel_for と同じことを、作っておいたスレッドで行う。呼び出し1回あたりのスレッド生成をなくしたいとき (SA の1反復ごとなど) に使う
+    // 呼び出し側のスレッドも worker 0 として働く。run は同時に1つしか呼ばないこと
+    class worker_pool {
+        public:
+        explicit worker_pool(int n_threads) : n_threads(max(1, n_threads)) {
+            for (int t = 1; t < this->n_threads; t++) workers.emplace_back([this, t]() { work(t); });
+        }
+
+        ~worker_pool() {
+            {
+                lock_guard<mutex> lock(m);
+                stopping = true;
             }
+            wake.notify_all();
+            for (auto& worker : workers) worker.join();
         }
 
-        if (problem.pillars.empty()) {
-            return musician_unblocked_pairs;
+        worker_pool(const worker_pool&) = delete;
+        worker_pool& operator=(const worker_pool&) = delete;
+
+        int size() const { return n_threads; }
+
+        template <class F>
+        void run(const int n, const F& f) {
+            if (n_threads == 1 || n <= 1) {
+                for (int i = 0; i < n; i++) f(i, 0);
+                return;
+            }
+            {
+                lock_guard<mutex> lock(m);
+                job = [&f](int i, int t) { f(i, t); };
+                job_size = n;
+                next = 0;
+                running = n_threads - 1;
+                generation++;
+            }
+            wake.notify_all();
+            for (int i = next++; i < n; i = next++) f(i, 0);
+            unique_lock<mutex> lock(m);
+            done.wait(lock, [this]() { return running == 0; });
         }
 
-        vector<pair<int, int>> pillar_unblocked_pairs;
-        for (int i_attendee = 0; i_attendee < n_attendee; i_attendee++) {
-            for (auto i_musician: get_unblocked_musician_of_attendee(
-                problem, placements, i_attendee
-            )) {
-                pillar_unblocked_pairs.emplace_back(i_musician, i_attendee);
+        private:
+        const int n_threads;
+        vector<thread> workers;
+        mutex m;
+        condition_variable wake;
+        condition_variable done;
+        function<void(int, int)> job;
+        int job_size = 0;
+        atomic<int> next{0};
+        int running = 0;
+        long long generation = 0;
+        bool stopping = false;
+
+        void work(int t) {
+            long long seen = 0;
+            while (true) {
+                {
+                    unique_lock<mutex> lock(m);
+                    wake.wait(lock, [&]() { return stopping || generation != seen; });
+                    if (stopping) return;
+                    seen = generation;
+                }
+                for (int i = next++; i < job_size; i = next++) job(i, t);
+                {
+                    lock_guard<mutex> lock(m);
+                    running--;
+                }
+                done.notify_one();
             }
         }
-        
-        sort(musician_unblocked_pairs.begin(), musician_unblocked_pairs.end());
-        sort(pillar_unblocked_pairs.begin(), pillar_unblocked_pairs.end());
+    };
 
-        vector<pair<int, int>> unblocked_pairs;
-        set_intersection(
-            musician_unblocked_pairs.begin(), musician_unblocked_pairs.end(),
-            pillar_unblocked_pairs.begin(), pillar_unblocked_pairs.end(),
-            std::inserter(unblocked_pairs, unblocked_pairs.end())
-        );
+    // musicians × attendees の可視フラグ。演奏家ごとに聴衆 64 人分ずつ 1 word に詰めて持つ
+    struct visibility_t {
+        int n_musician;
+        int n_attendee;
+        int n_words;
+        vector<uint64_t> bits;
+
+        visibility_t(int n_musician, int n_attendee) : n_musician(n_musician), n_attendee(n_attendee), n_words((n_attendee + 63) / 64), bits((size_t) n_musician * n_words, 0) {}
+
+        uint64_t* row(int i_musician) { return &bits[(size_t) i_musician * n_words]; }
+        const uint64_t* row(int i_musician) const { return &bits[(size_t) i_musician * n_words]; }
+
+        bool get(int i_musician, int i_attendee) const { return row(i_musician)[i_attendee >> 6] >> (i_attendee & 63) & 1; }
+        void set(int i_musician, int i_attendee) { row(i_musician)[i_attendee >> 6] |= 1ULL << (i_attendee & 63); }
+        void reset(int i_musician, int i_attendee) { row(i_musician)[i_attendee >> 6] &= ~(1ULL << (i_attendee & 63)); }
 
+        // 演奏家 i_musician から見える聴衆を番号順に f に渡す
+        template <class F>
+        void for_each(int i_musician, const F& f) const {
+            const uint64_t* words = row(i_musician);
+            for (int w = 0; w < n_words; w++) {
+                for (uint64_t word = words[w]; word != 0; word &= word - 1) {
+                    f(w * 64 + __builtin_ctzll(word));
+                }
+            }
+        }
+    };
+
+    // 演奏家によるブロックでビットを立て、柱によるブロックでビットを落とす
+    // 柱のパスは聴衆 64 人 (= 1 word) 単位で分担するので、スレッド間で同じ word に書くことはない
+    visibility_t get_visibility(const problem_t& problem, const vector<P>& placements, const int n_threads = 1) {
+        const int n_musician = problem.musicians.size();
+        const int n_attendee = problem.attendees.size();
+        visibility_t visible(n_musician, n_attendee);
+
+        parallel_for(n_musician, n_threads, [&](int i_musician, int) {
+            for (auto i_attendee : get_unblocked_attendees_of_musician(problem, placements, i_musician)) {
+                visible.set(i_musician, i_attendee);
+            }
+        });
+
+        if (!problem.pillars.empty()) {
+            const pillar_index pillars(problem);
+            parallel_for(visible.n_words, n_threads, [&](int w, int) {
+                vector<uint64_t> mask(n_musician, 0);
+                const int end = min(n_attendee, (w + 1) * 64);
+                for (int i_attendee = w * 64; i_attendee < end; i_attendee++) {
+                    for (auto i_musician : get_unblocked_musician_of_attendee(problem, placements, i_attendee, &pillars)) {
+                        mask[i_musician] |= 1ULL << (i_attendee & 63);
+                    }
+                }
+                for (int i_musician = 0; i_musician < n_musician; i_musician++) {
+                    visible.row(i_musician)[w] &= mask[i_musician];
+                }
+            });
+        }
+        return visible;
+    }
+
+    vector<pair<int, int>> get_unblocked_pairs(const problem_t& problem, const vector<P>& placements) {
+        const visibility_t visible = get_visibility(problem, placements);
+        vector<pair<int, int>> unblocked_pairs;
+        for (int i_musician = 0; i_musician < visible.n_musician; i_musician++) {
+            visible.for_each(i_musician, [&](int i_attendee) {
+                unblocked_pairs.emplace_back(i_musician, i_attendee);
+            });
+        }
         return unblocked_pairs;
     }
 
-    long long score(const problem_t& problem, const solution_t& solution) {
-        const auto& placements = solution.as_p();
+    vector<number> get_closeness(const problem_t& problem, const vector<P>& placements) {
         map<int, vector<int>> instrument_groups;
         for (int musician_id = 0; musician_id < (int) problem.musicians.size(); musician_id++) {
             instrument_groups[problem.musicians[musician_id]].push_back(musician_id);
@@ -283,18 +390,46 @@ namespace manarimo {
                 }
             }
         }
+        return closeness;
+    }
 
-        vector<pair<int, int>> unblocked_pairs = get_unblocked_pairs(problem, placements);
-
+    long long score_of_musician(const problem_t& problem, const solution_t& solution, const vector<P>& placements, const vector<number>& closeness, const visibility_t& visible, const int i_musician) {
         long long score = 0;
-        for (auto unblocked_pair : unblocked_pairs) {
-            const int i_musician = unblocked_pair.first;
-            const int i_attendee = unblocked_pair.second;
+        visible.for_each(i_musician, [&](int i_attendee) {
             const P attendee_location = {problem.attendees[i_attendee].x, problem.attendees[i_attendee].y};
             score += ceil(solution.volumes[i_musician] * closeness[i_musician] * ceil(1000000 * problem.attendees[i_attendee].tastes[problem.musicians[i_musician]] / d(attendee_location, placements[i_musician])));
+        });
+        return score;
+    }
+
+    long long score(const problem_t& problem, const solution_t& solution) {
+        const auto& placements = solution.as_p();
+        const vector<number> closeness = get_closeness(problem, placements);
+        const visibility_t visible = get_visibility(problem, placements);
+
+        long long score = 0;
+        for (int i_musician = 0; i_musician < visible.n_musician; i_musician++) {
+            score += score_of_musician(problem, solution, placements, closeness, visible, i_musician);
         }
         return score;
     }
+
+    // score() と同じ値を返す。演奏家ごと・聴衆ごとのスイープを n_threads 本のスレッドで分担する
+    long long score_parallel(const problem_t& problem, const solution_t& solution, const int n_threads) {
+        const auto& placements = solution.as_p();
+        const vector<number> closeness = get_closeness(problem, placements);
+        const visibility_t visible = get_visibility(problem, placements, n_threads);
+
+        // 各項は整数値の double なので、どの順で足しても score() と同じ整数になる
+        vector<long long> partial_scores(visible.n_musician, 0);
+        parallel_for(visible.n_musician, n_threads, [&](int i_musician, int) {
+            partial_scores[i_musician] = score_of_musician(problem, solution, placements, closeness, visible, i_musician);
+        });
+
+        long long score = 0;
+        for (long long partial_score : partial_scores) score += partial_score;
+        return score;
+    }
 };
 
 #endif //ICFPC2023_SCORING_H
\ No newline at end of file
@@ -3,26 +3,95 @@
 
 #include <cstdio>
 #include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include "rng.h"
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <cpuid.h>
+#endif
 
 namespace sa {
+    using namespace std;
+
+    // 経過時間を測る時計。x86-64 で不変 TSC が使えるなら rdtsc を、そうでなければ steady_clock を使う
+    // TSC の周波数は CPUID leaf 0x15 から読み、読めなければ起動時に steady_clock と比べて測る
+    // rdtsc は数十サイクルで読めるので、毎反復 get_time() を呼んでもよい
     class timer {
         public:
         void start() {
-            origin = rdtsc();
+            if (tsc().usable) {
+                origin_tick = rdtsc();
+            } else {
+                origin = chrono::steady_clock::now();
+            }
         }
-        
-        inline double get_time() {
-            return (rdtsc() - origin) * SECONDS_PER_CLOCK;
+
+        inline double get_time() const {
+            if (tsc().usable) {
+                return (rdtsc() - origin_tick) * tsc().seconds_per_tick;
+            } else {
+                return chrono::duration<double>(chrono::steady_clock::now() - origin).count();
+            }
         }
-        
+
+        // rdtsc を使っているか (使っていれば何 Hz として換算しているか) を表示する
+        static void print_source() {
+            if (tsc().usable) {
+                fprintf(stderr, "timer: rdtsc %.3f GHz\n", 1e-9 / tsc().seconds_per_tick);
+            } else {
+                fprintf(stderr, "timer: steady_clock\n");
+            }
+        }
+
         private:
-        constexpr static double SECONDS_PER_CLOCK = 1 / 3.0e9;
-        unsigned long long origin;
-        
+        unsigned long long origin_tick = 0;
+        chrono::steady_clock::time_point origin;
+
+        struct tsc_info {
+            bool usable = false;
+            double seconds_per_tick = 0;
+        };
+
+        static const tsc_info& tsc() {
+            static const tsc_info info = calibrate();
+            return info;
+        }
+
+        static tsc_info calibrate() {
+            tsc_info info;
+#if defined(__x86_64__) && defined(__GNUC__)
+            unsigned eax, ebx, ecx, edx;
+            // 不変 TSC (CPUID 0x80000007 EDX bit 8) でなければ周波数が変わりうるので使わない
+            if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1u << 8))) return info;
+            if (__get_cpuid(0x15, &eax, &ebx, &ecx, &edx) && eax != 0 && ebx != 0 && ecx != 0) {
+                info.seconds_per_tick = (double) eax / ((double) ecx * ebx);
+            } else {
+                // 20ms 回して steady_clock と比べる
+                auto begin = chrono::steady_clock::now();
+                unsigned long long begin_tick = rdtsc();
+                auto now = begin;
+                while (now - begin < chrono::milliseconds(20)) now = chrono::steady_clock::now();
+                unsigned long long ticks = rdtsc() - begin_tick;
+                if (ticks == 0) return info;
+                info.seconds_per_tick = chrono::duration<double>(now - begin).count() / ticks;
+            }
+            info.usable = true;
+#endif
+            return info;
+        }
+
         inline static unsigned long long rdtsc() {
+#if defined(__x86_64__) && defined(__GNUC__)
             unsigned long long lo, hi;
             __asm__ volatile ("rdtsc" : "=a" (lo), "=d" (hi));
             return (hi << 32) | lo;
+#else
+            return 0;
+#endif
         }
     };
 
@@ -30,7 +99,7 @@ namespace sa {
         public:
         // [0, x)
         inline static unsigned get(unsigned x) {
-            return ((unsigned long long)xorshift() * x) >> 32;
+            return generator().get(x);
         }
         
         // [x, y]
@@ -40,76 +109,198 @@ namespace sa {
         
         // [0, x] (x = 2^c - 1)
         inline static unsigned get_fast(unsigned x) {
-            return xorshift() & x;
+            return generator().get_fast(x);
         }
         
-        // [0.0, 1.0]
+        // (0.0, 1.0)
         inline static double probability() {
-            return xorshift() * INV_MAX;
+            return generator().probability();
         }
         
         inline static bool toss() {
-            return xorshift() & 1;
+            return generator().toss();
         }
         
-        private:
-        constexpr static double INV_MAX = 1.0 / 0xFFFFFFFF;
-        
-        inline static unsigned xorshift() {
-            static unsigned x = 123456789, y = 362436039, z = 521288629, w = 88675123;
-            unsigned t = x ^ (x << 11);
-            x = y, y = z, z = w;
-            return w = (w ^ (w >> 19)) ^ (t ^ (t >> 8));
+        // スレッドごとに持つ xoshiro256** (library/rng.h)。SEED 環境変数で系列を固定できる
+        static manarimo::rng& generator() {
+            static thread_local manarimo::rng instance(manarimo::seed_from_env());
+            return instance;
+        }
+    };
+
+    // 温度スケジュールの設定。既定値は以前の固定値 (10 秒、1000 から 1e-9 へ線形) と同じ
+    struct schedule {
+        enum cooling_t {
+            LINEAR,     // start_temp から end_temp へ線形
+            GEOMETRIC,  // start_temp から end_temp へ指数的
+        };
+
+        schedule(double time_limit = 10, double start_temp = 1000, double end_temp = 1e-9) : time_limit(time_limit), start_temp(start_temp), end_temp(end_temp) {}
+
+        cooling_t cooling = LINEAR;
+        double time_limit;
+        // 0 より大きければ時間ではなく反復回数で進み具合を測る (再現実験用)
+        long long max_iterations = 0;
+        double start_temp;
+        double end_temp;
+        // 途中で温度を戻す回数。戻すたびに開始温度に reheat_decay を掛ける
+        int reheats = 0;
+        double reheat_decay = 1;
+        // 0 より大きければ、悪化する遷移の採用率がこの値に近づくよう温度に掛ける係数を調整する
+        double target_acceptance = 0;
+        double adapt_rate = 0.1;
+        // 時間と温度を更新する間隔 (2^k - 1)。0 なら毎反復
+        int update_interval = 0xFF;
+        bool maximize = true;
+
+        // SA_COOLING (linear/geometric), SA_MAX_ITERATIONS, SA_START_TEMP, SA_END_TEMP,
+        // SA_REHEATS, SA_REHEAT_DECAY, SA_TARGET_ACCEPTANCE, SA_ADAPT_RATE, SA_UPDATE_INTERVAL があれば上書きする
+        schedule& override_from_env() {
+            if (const char* v = getenv("SA_COOLING")) cooling = string(v) == "geometric" ? GEOMETRIC : LINEAR;
+            if (const char* v = getenv("SA_MAX_ITERATIONS")) max_iterations = atoll(v);
+            if (const char* v = getenv("SA_START_TEMP")) start_temp = atof(v);
+            if (const char* v = getenv("SA_END_TEMP")) end_temp = atof(v);
+            if (const char* v = getenv("SA_REHEATS")) reheats = atoi(v);
+            if (const char* v = getenv("SA_REHEAT_DECAY")) reheat_decay = atof(v);
+            if (const char* v = getenv("SA_TARGET_ACCEPTANCE")) target_acceptance = atof(v);
+            if (const char* v = getenv("SA_ADAPT_RATE")) adapt_rate = atof(v);
+            if (const char* v = getenv("SA_UPDATE_INTERVAL")) update_interval = atoi(v);
+            return *this;
         }
     };
 
     class simulated_annealing {
         public:
-        simulated_annealing();
+        // clock は開始からの経過秒を返す単調な時計。省略すると較正済みの timer を使う
+        explicit simulated_annealing(const schedule& config = schedule(), function<double()> clock = nullptr);
         inline bool end();
-        inline bool accept(double current_score, double next_score);
+        inline bool accept(double current_score, double next_score, int type = 0);
+        inline void reject(int type = 0);
+        // accept で使う乱数を評価の前に引き、採用に必要なスコアの下限 (minimize なら上限) を返す
+        // 評価の途中で、残りをどう足してもこの値を超えないと分かった遷移はその場で打ち切ってよい
+        inline double threshold(double current_score);
+        // threshold で引いた乱数で採否を決める。打ち切った遷移は next_score に上界 (minimize なら下界) を渡す
+        inline bool accept_threshold(double next_score, double threshold, int type = 0);
         void print() const;
-        
+
+        double temperature() const { return temp; }
+        // 0 から 1 への進み具合
+        double progress() const { return current_progress; }
+        long long iterations() const { return iteration; }
+        long long accepted_count(int type) const { return type < (int) accepted_by_type.size() ? accepted_by_type[type] : 0; }
+        long long rejected_count(int type) const { return type < (int) rejected_by_type.size() ? rejected_by_type[type] : 0; }
+
         private:
-        constexpr static bool MAXIMIZE = true;
         constexpr static int LOG_SIZE = 0xFFFF;
-        constexpr static int UPDATE_INTERVAL = 0xFF;
-        constexpr static double TIME_LIMIT = 10;
-        constexpr static double START_TEMP = 1000;
-        constexpr static double END_TEMP = 1e-9;
-        constexpr static double TEMP_RATIO = (END_TEMP - START_TEMP) / TIME_LIMIT;
+        schedule config;
+        function<double()> clock;
         double log_probability[LOG_SIZE + 1];
         long long iteration = 0;
         long long accepted = 0;
         long long rejected = 0;
-        double time = 0;
-        double temp = START_TEMP;
-        timer sa_timer;
+        vector<long long> accepted_by_type;
+        vector<long long> rejected_by_type;
+        // 直近の更新間隔での悪化する遷移の数と、そのうち採用した数
+        long long worse_proposed = 0;
+        long long worse_accepted = 0;
+        double adapt = 1;
+        double current_progress = 0;
+        double temp;
+        // 直前の threshold に渡されたスコア
+        double threshold_base = 0;
+
+        double scheduled_temperature(double progress) const;
+        void count(vector<long long>& by_type, int type) {
+            if (type >= (int) by_type.size()) by_type.resize(type + 1);
+            by_type[type]++;
+        }
     };
 
-    simulated_annealing::simulated_annealing() {
-        sa_timer.start();
+    simulated_annealing::simulated_annealing(const schedule& config, function<double()> clock) : config(config), clock(clock), temp(config.start_temp) {
+        if (!this->clock) {
+            timer sa_timer;
+            sa_timer.start();
+            this->clock = [sa_timer]() { return sa_timer.get_time(); };
+        }
         for (int i = 0; i <= LOG_SIZE; i++) log_probability[i] = log(random::probability());
     }
 
+    double simulated_annealing::scheduled_temperature(double progress) const {
+        double start_temp = config.start_temp;
+        if (config.reheats > 0) {
+            // 進み具合を reheats + 1 個の区間に分け、区間ごとに冷却をやり直す
+            double scaled = min(progress, 1.0) * (config.reheats + 1);
+            int cycle = min((int) scaled, config.reheats);
+            progress = scaled - cycle;
+            start_temp *= pow(config.reheat_decay, cycle);
+        }
+        if (config.cooling == schedule::GEOMETRIC) {
+            return start_temp * pow(config.end_temp / start_temp, progress);
+        } else {
+            return start_temp + (config.end_temp - start_temp) * progress;
+        }
+    }
+
     inline bool simulated_annealing::end() {
         iteration++;
-        if ((iteration & UPDATE_INTERVAL) == 0) {
-            time = sa_timer.get_time();
-            temp = START_TEMP + TEMP_RATIO * time;
-            return time >= TIME_LIMIT;
+        if ((iteration & config.update_interval) == 0) {
+            if (config.max_iterations > 0) {
+                current_progress = (double) iteration / config.max_iterations;
+            } else {
+                current_progress = clock() / config.time_limit;
+            }
+            if (config.target_acceptance > 0 && worse_proposed > 0) {
+                double rate = (double) worse_accepted / worse_proposed;
+                adapt *= exp(config.adapt_rate * (config.target_acceptance - rate));
+                adapt = min(max(adapt, 1e-3), 1e3);
+                worse_proposed = worse_accepted = 0;
+            }
+            temp = scheduled_temperature(current_progress) * adapt;
+            return current_progress >= 1;
         } else {
             return false;
         }
     }
 
-    inline bool simulated_annealing::accept(double current_score, double next_score) {
-        double diff = (MAXIMIZE ? next_score - current_score : current_score - next_score);
+    inline bool simulated_annealing::accept(double current_score, double next_score, int type) {
+        double diff = (config.maximize ? next_score - current_score : current_score - next_score);
+        if (diff < 0) worse_proposed++;
         if (diff >= 0 || diff > log_probability[random::get_fast(LOG_SIZE)] * temp) {
+            if (diff < 0) worse_accepted++;
             accepted++;
+            count(accepted_by_type, type);
             return true;
         } else {
             rejected++;
+            count(rejected_by_type, type);
+            return false;
+        }
+    }
+
+    // accept を呼ぶまでもなく捨てた遷移 (置けない位置など) を数える。悪化する遷移としては数えない
+    // threshold の閾値に届かないと分かって打ち切った遷移は、reject ではなく accept_threshold に上界を渡す
+    inline void simulated_annealing::reject(int type) {
+        rejected++;
+        count(rejected_by_type, type);
+    }
+
+    inline double simulated_annealing::threshold(double current_score) {
+        threshold_base = current_score;
+        double margin = log_probability[random::get_fast(LOG_SIZE)] * temp;
+        return config.maximize ? current_score + margin : current_score - margin;
+    }
+
+    inline bool simulated_annealing::accept_threshold(double next_score, double threshold, int type) {
+        double diff = (config.maximize ? next_score - threshold_base : threshold_base - next_score);
+        if (diff < 0) worse_proposed++;
+        if (diff >= 0 || (config.maximize ? next_score > threshold : next_score < threshold)) {
+            if (diff < 0) worse_accepted++;
+            accepted++;
+            count(accepted_by_type, type);
+            return true;
+        } else {
+            rejected++;
+            count(rejected_by_type, type);
             return false;
         }
     }
@@ -117,13 +308,22 @@ namespace sa {
     void simulated_annealing::print() const {
         fprintf(stderr, "iteration: %lld\n", iteration);
         fprintf(stderr, "accepted: %lld\n", accepted);
+        if (accepted_by_type.size() > 1) {
+            for (int i = 0; i < (int) accepted_by_type.size(); i++) fprintf(stderr, "\taccepted-%d: %lld\n", i, accepted_by_type[i]);
+        }
         fprintf(stderr, "rejected: %lld\n", rejected);
+        if (rejected_by_type.size() > 1) {
+            for (int i = 0; i < (int) rejected_by_type.size(); i++) fprintf(stderr, "\trejected-%d: %lld\n", i, rejected_by_type[i]);
+        }
+        fprintf(stderr, "temperature: %g\n", temp);
     }
 };
 
 /*
 int main() {
-    simulated_annealing sa;
+    sa::schedule config(10, 1000, 1e-9);
+    config.cooling = sa::schedule::GEOMETRIC;
+    sa::simulated_annealing sa(config.override_from_env());
     while (!sa.end()) {
         double current_score = 100;
         double next_score = 100;
@@ -6,6 +6,8 @@
 #include <vector>
 #include <string>
 #include <fstream>
+#include <cstdio>
+#include <filesystem>
 
 namespace manarimo {
     using namespace std;
@@ -32,6 +34,7 @@ namespace manarimo {
         solution_t() {}
         solution_t(const vector<P>& placements): solution_t(placements, vector<number>(placements.size(), 1.)) {}
         solution_t(const vector<P>& placements, const vector<number>& volumes): volumes(volumes) {
+            this->placements.reserve(placements.size());
             for (auto p : placements) {
                 P3 p3;
                 p3.x = p.first;
@@ -78,9 +81,84 @@ namespace manarimo {
         return load_solution(f, out);
     }
 
+    // json と同じ最短表現 (round-trip する桁数) で double を書き込む
+    void append_number(string &out, number x) {
+        if (!isfinite(x)) {
+            out += "null";
+            return;
+        }
+        char buffer[64];
+        char* end = nlohmann::detail::to_chars(buffer, buffer + sizeof(buffer), x);
+        out.append(buffer, end);
+    }
+
+    number placement_x(const P &p) { return p.first; }
+    number placement_y(const P &p) { return p.second; }
+    number placement_x(const P3 &p) { return p.x; }
+    number placement_y(const P3 &p) { return p.y; }
+
+    // json の DOM を作らずに出力する。出力は json(solution_t) を dump したものと同じ
+    template <class Placements>
+    void format_solution(string &out, const Placements &placements, const vector<number> &volumes) {
+        out.clear();
+        out.reserve(48 * placements.size() + 24 * volumes.size() + 32);
+        out += "{\"placements\":[";
+        for (size_t i = 0; i < placements.size(); i++) {
+            if (i) out += ',';
+            out += "{\"x\":";
+            append_number(out, placement_x(placements[i]));
+            out += ",\"y\":";
+            append_number(out, placement_y(placements[i]));
+            out += '}';
+        }
+        out += "],\"volumes\":[";
+        for (size_t i = 0; i < volumes.size(); i++) {
+            if (i) out += ',';
+            append_number(out, volumes[i]);
+        }
+        out += "]}";
+    }
+
+    void print_solution(ostream &f, const vector<P> &placements, const vector<number> &volumes) {
+        string out;
+        format_solution(out, placements, volumes);
+        f << out;
+    }
+
+    void print_solution(ostream &f, const vector<P> &placements) {
+        print_solution(f, placements, vector<number>(placements.size(), 1.));
+    }
+
     void print_solution(ostream &f, const solution_t &val) {
-        json j(val);
-        f << j;
+        string out;
+        format_solution(out, val.placements, val.volumes);
+        f << out;
+    }
+
+    // 一時ファイルに書いてから rename するので、途中で落ちても壊れたファイルが残らない
+    // buffer は呼び出し側で使い回すと書き込みごとの確保がなくなる
+    bool store_solution(const string &filename, const vector<P> &placements, const vector<number> &volumes, string &buffer) {
+        format_solution(buffer, placements, volumes);
+        const string tmp_filename = filename + ".tmp";
+        FILE* fp = fopen(tmp_filename.c_str(), "wb");
+        if (fp == nullptr) return false;
+        const bool written = fwrite(buffer.data(), 1, buffer.size(), fp) == buffer.size();
+        if (fclose(fp) != 0 || !written) {
+            remove(tmp_filename.c_str());
+            return false;
+        }
+        error_code ec;
+        filesystem::rename(tmp_filename, filename, ec);
+        return !ec;
+    }
+
+    bool store_solution(const string &filename, const vector<P> &placements, const vector<number> &volumes) {
+        string buffer;
+        return store_solution(filename, placements, volumes, buffer);
+    }
+
+    bool store_solution(const string &filename, const vector<P> &placements) {
+        return store_solution(filename, placements, vector<number>(placements.size(), 1.));
     }
 };
 
@@ -0,0 +1,131 @@
+#ifndef ICFPC2023_SPATIAL_GRID_H
+#define ICFPC2023_SPATIAL_GRID_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "geo.h"
+
+namespace manarimo {
+    using namespace std;
+    using namespace geo;
+
+    // 演奏家の位置を一辺 cell の正方形のマスに振り分けて持つ
+    // 半径 cell 以内の点は周囲 3x3 マスにしかいないので、衝突判定が演奏家の数によらず定数時間になる
+    // 演奏家同士が 10 離れていれば一辺 10 のマスには高々 4 人しか入らない
+    // マスの中は演奏家番号の片方向リストで持つ。範囲外の点は端のマスに入れる
+    class spatial_grid {
+        public:
+        spatial_grid() {}
+        spatial_grid(number left, number bottom, number width, number height, number cell = 10) {
+            reset(left, bottom, width, height, cell);
+        }
+
+        // [left, left + width] x [bottom, bottom + height] を覆う空のグリッドにする
+        void reset(number left, number bottom, number width, number height, number cell = 10) {
+            this->left = left;
+            this->bottom = bottom;
+            this->cell = cell;
+            columns = max(1, (int) ceil(width / cell) + 1);
+            rows = max(1, (int) ceil(height / cell) + 1);
+            head.assign((size_t) columns * rows, -1);
+            next.clear();
+            cell_of.clear();
+            points.clear();
+        }
+
+        // points[i] を演奏家 i として入れ直す
+        void build(const vector<P>& points) {
+            fill(head.begin(), head.end(), -1);
+            const int n = points.size();
+            this->points = points;
+            next.assign(n, -1);
+            cell_of.assign(n, -1);
+            for (int i = 0; i < n; i++) link(i);
+        }
+
+        // 演奏家 id を p に置く。id は 0, 1, 2, ... の順に増やすこと (random_init のように1人ずつ置く場合)
+        void insert(int id, const P& p) {
+            if (id >= (int) points.size()) {
+                points.resize(id + 1);
+                next.resize(id + 1, -1);
+                cell_of.resize(id + 1, -1);
+            }
+            points[id] = p;
+            link(id);
+        }
+
+        void move(int id, const P& p) {
+            const int c = cell_index(p);
+            points[id] = p;
+            if (c == cell_of[id]) return;
+            unlink(id);
+            link(id);
+        }
+
+        // 演奏家 a と b の位置を入れ替える
+        void swap_positions(int a, int b) {
+            unlink(a);
+            unlink(b);
+            std::swap(points[a], points[b]);
+            link(a);
+            link(b);
+        }
+
+        // ignore 以外で p から距離の2乗が r2 未満の演奏家がいるか。r2 <= cell^2 であること
+        bool collides(const P& p, number r2, int ignore = -1) const {
+            bool found = false;
+            for_each_near(p, [&](int id) {
+                if (id == ignore || found) return;
+                if (d(points[id], p) < r2) found = true;
+            });
+            return found;
+        }
+
+        // p を含むマスと周囲 8 マスの演奏家それぞれについて f(id) を呼ぶ
+        template<class F>
+        void for_each_near(const P& p, F f) const {
+            const int cx = column_of(p.first);
+            const int cy = row_of(p.second);
+            for (int y = max(0, cy - 1); y <= min(rows - 1, cy + 1); y++) {
+                for (int x = max(0, cx - 1); x <= min(columns - 1, cx + 1); x++) {
+                    for (int id = head[(size_t) y * columns + x]; id != -1; id = next[id]) f(id);
+                }
+            }
+        }
+
+        const P& position(int id) const { return points[id]; }
+
+        private:
+        number left = 0;
+        number bottom = 0;
+        number cell = 10;
+        int columns = 1;
+        int rows = 1;
+        vector<int> head;
+        vector<int> next;
+        vector<int> cell_of;
+        vector<P> points;
+
+        int column_of(number x) const { return min(columns - 1, max(0, (int) floor((x - left) / cell))); }
+        int row_of(number y) const { return min(rows - 1, max(0, (int) floor((y - bottom) / cell))); }
+        int cell_index(const P& p) const { return row_of(p.second) * columns + column_of(p.first); }
+
+        void link(int id) {
+            const int c = cell_index(points[id]);
+            cell_of[id] = c;
+            next[id] = head[c];
+            head[c] = id;
+        }
+
+        void unlink(int id) {
+            int* slot = &head[cell_of[id]];
+            while (*slot != id) slot = &next[*slot];
+            *slot = next[id];
+            next[id] = -1;
+            cell_of[id] = -1;
+        }
+    };
+};
+
+#endif //ICFPC2023_SPATIAL_GRID_H
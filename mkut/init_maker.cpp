@@ -9,6 +9,8 @@
 #endif
 #include "../library/scoring.h"
 #include "../library/solution.h"
+#include "../library/impact_field.h"
+#include "../library/greedy_placer.h"
 
 using namespace std;
 
@@ -29,6 +31,18 @@ double get_angle(const geo::P& p1, const geo::P& p2) {
     return atan2(p2.Y - p1.Y, p2.X - p1.X);
 }
 
+// p から見て q にいる演奏家が隠す角度の範囲 [start, end]。角度 a (と a + 2π) がこの中にある聴衆が隠れる
+void blocking_window(const geo::P& p, const geo::P& q, double& start, double& end) {
+    double angle = get_angle(p, q);
+    double offset = asin(BLOCK_RADIUS / sqrt(geo::d(p, q)));
+    start = angle - offset;
+    end = angle + offset;
+    if (start < -M_PI) {
+        start += M_PI * 2;
+        end += M_PI * 2;
+    }
+}
+
 void calc_blocked_one(int musician, const geo::P& p, vector<pair<double, int>>& attendee_angles, vector<int>* blocked_attendees, int* blocked_count, const vector<geo::P>& current_placements) {
     attendee_angles.clear();
     for (int i = 0; i < problem.attendees.size(); i++) {
@@ -42,14 +56,8 @@ void calc_blocked_one(int musician, const geo::P& p, vector<pair<double, int>>&
     for (int i = 0; i < problem.attendees.size(); i++) blocked_count[i] = 0;
     for (int i = 0; i < current_placements.size(); i++) {
         if (i == musician) continue;
-        double angle = get_angle(p, current_placements[i]);
-        double offset = asin(BLOCK_RADIUS / sqrt(geo::d(p, current_placements[i])));
-        double start = angle - offset;
-        double end = angle + offset;
-        if (start < -M_PI) {
-            start += M_PI * 2;
-            end += M_PI * 2;
-        }
+        double start, end;
+        blocking_window(p, current_placements[i], start, end);
         int index = lower_bound(attendee_angles.begin(), attendee_angles.end(), make_pair(start, -1)) - attendee_angles.begin();
         for (; index < attendee_angles.size(); index++) {
             if (attendee_angles[index].first > end) break;
@@ -78,8 +86,64 @@ double score_all(const vector<geo::P>& placements) {
     return sum;
 }
 
-// g++ -std=c++2a -O3 kawatea_random.cpp
-// ./a.out 1.x.json < ../problems/1.json > 1.json
+// 長方形の 4 隅 corners のどこから見ても placements[since..] のどれかに隠れる聴衆のビットを visible から落とす
+// 長方形は凸なので、4 隅それぞれから聴衆への線分が演奏家の円 (少し小さくしたもの) を通れば、中のどの点からでも calc_blocked_one で隠れる
+// 演奏家が多いときは、corners[0] から見た角度で並べた聴衆のうち、演奏家の円が掛かる角度の範囲だけを調べる
+void drop_hidden(const geo::P (&corners)[4], const vector<geo::P>& placements, int since, uint64_t* visible, vector<pair<double, int>>& angles) {
+    const double r = BLOCK_RADIUS - 1e-6;
+    const int n_attendee = problem.attendees.size();
+    auto is_visible = [&](int j) { return visible[j >> 6] >> (j & 63) & 1; };
+    auto try_hide = [&](int j, const geo::P& q) {
+        for (const geo::P& c : corners) {
+            if (geo::dist_line(c, problem.attendees[j].pos, q) > r * r) return false;
+        }
+        visible[j >> 6] &= ~(1ULL << (j & 63));
+        return true;
+    };
+    if (placements.size() - since <= 8) {
+        for (int j = 0; j < n_attendee; j++) {
+            if (!is_visible(j)) continue;
+            for (int k = since; k < placements.size(); k++) {
+                if (try_hide(j, placements[k])) break;
+            }
+        }
+        return;
+    }
+    const geo::P& c = corners[0];
+    angles.clear();
+    for (int j = 0; j < n_attendee; j++) {
+        if (!is_visible(j)) continue;
+        double angle = get_angle(c, problem.attendees[j].pos);
+        angles.emplace_back(angle, j);
+        angles.emplace_back(angle + M_PI * 2, j);
+    }
+    sort(angles.begin(), angles.end());
+    for (int k = since; k < placements.size(); k++) {
+        const geo::P& q = placements[k];
+        const double d = sqrt(geo::d(c, q));
+        if (d <= r) {
+            for (int j = 0; j < n_attendee; j++) if (is_visible(j)) try_hide(j, q);
+            continue;
+        }
+        // 線分が円を通るなら、聴衆の方向と演奏家の方向の差は asin(r / d) 以下。誤差の分だけ広げる
+        const double angle = get_angle(c, q);
+        const double offset = asin(r / d) + 1e-9;
+        double start = angle - offset;
+        double end = angle + offset;
+        if (start < -M_PI) {
+            start += M_PI * 2;
+            end += M_PI * 2;
+        }
+        int index = lower_bound(angles.begin(), angles.end(), make_pair(start, -1)) - angles.begin();
+        for (; index < angles.size() && angles[index].first <= end; index++) {
+            const int j = angles[index].second;
+            if (is_visible(j)) try_hide(j, q);
+        }
+    }
+}
+
+// g++ -std=c++2a -O3 -pthread init_maker.cpp
+// ./a.out [影響の格子のキャッシュ (../problems/1.field など)] < ../problems/1.json > 1.json
 int main(int argc, char *argv[]) {
     manarimo::load_problem(cin, problem);
     stage_left = problem.stage_bottom_left.first + 10;
@@ -96,36 +160,103 @@ int main(int argc, char *argv[]) {
         max_tastes.push_back(mx);
     }
 
-    set<geo::P> occupied;
-    vector<geo::P> placements;
+    // max_tastes >= 0 なので、評価値は演奏家が増えても (遮蔽が増えるだけなので) 増えない。greedy_placer で遅延評価する
+    // ブロックの上界には遮蔽を無視した値の区画ごとの上界を使う (1000000 倍して ceil したものなので、丸め誤差の分だけ余裕を持たせて戻す)
+    const vector<const double*> bound_rows = {max_tastes.data()};
+    const double width = stage_right - stage_left, height = stage_top - stage_bottom;
+    const int block = max(1, (int) round(manarimo::impact_field::default_spacing(width, height, 1, problem.attendees.size())));
+    manarimo::impact_field field;
+    field.load_or_build(argc > 1 ? string(argv[1]) : string(), problem, bound_rows, stage_left, stage_bottom, width, height, block);
 
-    for (int i = 0; i < problem.musicians.size(); i++) {
-        cerr << i << endl;
-        double mx_score = -1e9;
-        geo::P mx_p;
-        for (double x = stage_left; x <= stage_right; x++) {
-            for (double y = stage_bottom; y <= stage_top; y++) {
-                geo::P p(x, y);
-                double sc = 0;
-                if (occupied.count(p)) continue;
-                calc_blocked_one(i, p, attendee_angles[i], blocked_attendees[i], blocked_count[i], placements);
-                for (int j = 0; j < problem.attendees.size(); j++) if (blocked_count[i][j] == 0) sc += max_tastes[j] / geo::d(p, problem.attendees[j].pos);
-                if (sc > mx_score) {
-                    mx_score = sc;
-                    mx_p = p;
+    const int n_threads = max(1u, thread::hardware_concurrency());
+    manarimo::worker_pool pool(n_threads);
+    // ワーカーごとの作業領域
+    const int n_attendee = problem.attendees.size();
+    vector<vector<pair<double, int>>> worker_angles(n_threads);
+    vector<vector<vector<int>>> worker_blocked(n_threads, vector<vector<int>>(problem.musicians.size()));
+    vector<vector<int>> worker_count(n_threads, vector<int>(n_attendee));
+    vector<vector<pair<double, double>>> worker_windows(n_threads);
+
+    // 候補ごとに隠れていない聴衆のビット列を持つ
+    // 前回から置いた演奏家の分だけ calc_blocked_one と同じ判定でビットを落とせば、全部やり直したのと同じ集合になる
+    vector<geo::P> placements;
+    auto blocked_score = [&](const geo::P& p, uint64_t* unblocked, int since, int worker) {
+        int* count = worker_count[worker].data();
+        if (since < 0) {
+            calc_blocked_one(placements.size(), p, worker_angles[worker], worker_blocked[worker].data(), count, placements);
+            if (unblocked != nullptr) {
+                fill(unblocked, unblocked + (n_attendee + 63) / 64, 0);
+                for (int j = 0; j < n_attendee; j++) if (count[j] == 0) unblocked[j >> 6] |= 1ULL << (j & 63);
+            }
+        } else {
+            vector<pair<double, double>>& windows = worker_windows[worker];
+            windows.resize(placements.size() - since);
+            for (int k = since; k < placements.size(); k++) blocking_window(p, placements[k], windows[k - since].first, windows[k - since].second);
+            for (int j = 0; j < n_attendee; j++) {
+                count[j] = 1;
+                if (!(unblocked[j >> 6] >> (j & 63) & 1)) continue;
+                count[j] = 0;
+                if (windows.empty()) continue;
+                const double angle = get_angle(p, problem.attendees[j].pos);
+                const double angle2 = angle + M_PI * 2;
+                for (const auto& window : windows) {
+                    if ((angle >= window.first && angle <= window.second) || (angle2 >= window.first && angle2 <= window.second)) {
+                        count[j] = 1;
+                        unblocked[j >> 6] &= ~(1ULL << (j & 63));
+                        break;
+                    }
                 }
             }
         }
-        placements.push_back(mx_p);
-        for (double x = mx_p.first - RADIUS; x <= mx_p.first + RADIUS; x++) {
-            for (double y = mx_p.second - RADIUS; y <= mx_p.second + RADIUS; y++) {
-                geo::P p(x, y);
-                if (geo::d(p, mx_p) < RADIUS2) {
-                    occupied.insert(p);
-                }
+        double sc = 0;
+        for (int j = 0; j < n_attendee; j++) if (count[j] == 0) sc += max_tastes[j] / geo::d(p, problem.attendees[j].pos);
+        return sc;
+    };
+
+    const int n_columns = width >= 0 ? (int) floor(width) + 1 : 0;
+    const int n_rows = height >= 0 ? (int) floor(height) + 1 : 0;
+    const int words = (n_attendee + 63) / 64;
+    manarimo::greedy_placer placer(stage_left, stage_bottom, n_columns, n_rows, block, RADIUS, pool, words, words);
+    placer.init([&](int bx, int by) {
+        const double bound = field.cell_bound(0, min(bx, field.cell_columns() - 1), min(by, field.cell_rows() - 1));
+        return (bound + 1) * (1 + 1e-9) / 1000000;
+    });
+    // ブロックの上界: ブロックのどの点から見ても同じ演奏家に隠れる聴衆を除いて、残りを区画の上界と同じように足す
+    // ビット列には、まだ隠れると決まっていない聴衆を持つ
+    vector<vector<pair<double, int>>> worker_corner_angles(n_threads);
+    // 分けたブロックは親より小さいので、親で隠れると決まった聴衆は子でも隠れる
+    auto block_bound = [&](const geo::P& lower, const geo::P& upper, uint64_t* visible, const uint64_t* parent, int since, int worker) {
+        const geo::P corners[4] = {lower, {lower.first, upper.second}, {upper.first, lower.second}, upper};
+        if (since < 0) {
+            if (parent != nullptr) {
+                copy(parent, parent + words, visible);
+            } else {
+                fill(visible, visible + words, 0);
+                for (int j = 0; j < n_attendee; j++) visible[j >> 6] |= 1ULL << (j & 63);
             }
+            since = 0;
+        }
+        drop_hidden(corners, placements, since, visible, worker_corner_angles[worker]);
+        double bound = 0;
+        for (int j = 0; j < n_attendee; j++) {
+            if (!(visible[j >> 6] >> (j & 63) & 1)) continue;
+            const geo::P& a = problem.attendees[j].pos;
+            const double near_x = max({0.0, lower.first - a.first, a.first - upper.first});
+            const double near_y = max({0.0, lower.second - a.second, a.second - upper.second});
+            const double near2 = near_x * near_x + near_y * near_y;
+            if (near2 == 0) return numeric_limits<double>::infinity();
+            bound += ceil(1000000 * max_tastes[j] / near2);
         }
+        return (bound + 1) * (1 + 1e-9) / 1000000;
+    };
+
+    for (int i = 0; i < problem.musicians.size(); i++) {
+        cerr << i << endl;
+        geo::P mx_p;
+        if (placer.next(blocked_score, block_bound, mx_p)) placer.place(mx_p);
+        placements.push_back(mx_p);
     }
+    cerr << "evaluations: " << placer.evaluation_count() << ", block refinements: " << placer.refinement_count() << endl;
     
     vector<double> volumes = vector<double>();
     for (int i = 0; i < problem.musicians.size(); i++) volumes.push_back(10);
@@ -9,35 +9,21 @@
 #endif
 #include "../library/scoring.h"
 #include "../library/solution.h"
+#include "../library/rng.h"
+#include "../library/simulated_annealing.h"
+#include "../library/blocked_lists.h"
+#include "../library/arena.h"
+#include "../library/angular_index.h"
+#include "../library/spatial_grid.h"
+#include "../library/impact_kernels.h"
 
 using namespace std;
 
-class timer {
-    public:
-    void start() {
-        origin = rdtsc();
-    }
-    
-    inline double get_time() {
-        return (rdtsc() - origin) * SECONDS_PER_CLOCK;
-    }
-    
-    private:
-    constexpr static double SECONDS_PER_CLOCK = 1 / 3.0e9;
-    unsigned long long origin;
-    
-    inline static unsigned long long rdtsc() {
-        unsigned long long lo, hi;
-        __asm__ volatile ("rdtsc" : "=a" (lo), "=d" (hi));
-        return (hi << 32) | lo;
-    }
-};
-
 class random {
     public:
     // [0, x)
     inline static unsigned get(unsigned x) {
-        return ((unsigned long long)xorshift() * x) >> 32;
+        return generator().get(x);
     }
     
     // [x, y]
@@ -47,12 +33,12 @@ class random {
     
     // [0, x] (x = 2^c - 1)
     inline static unsigned get_fast(unsigned x) {
-        return xorshift() & x;
+        return generator().get_fast(x);
     }
     
-    // [0.0, 1.0]
+    // (0.0, 1.0)
     inline static double probability() {
-        return xorshift() * INV_MAX;
+        return generator().probability();
     }
     
     inline static double get_double(double x, double y) {
@@ -60,99 +46,25 @@ class random {
     }
     
     inline static bool toss() {
-        return xorshift() & 1;
+        return generator().toss();
     }
     
-    private:
-    constexpr static double INV_MAX = 1.0 / 0xFFFFFFFF;
-    
-    inline static unsigned xorshift() {
-        static unsigned x = 123456789, y = 362436039, z = 521288629, w = 88675123;
-        unsigned t = x ^ (x << 11);
-        x = y, y = z, z = w;
-        return w = (w ^ (w >> 19)) ^ (t ^ (t >> 8));
+    // sa::random と同じ系列を使う (library/rng.h)。SEED 環境変数で系列を固定できる
+    static manarimo::rng& generator() {
+        return sa::random::generator();
     }
 };
 
-class simulated_annealing {
-    public:
-    simulated_annealing(double time_limit);
-    inline bool end();
-    inline bool accept(double current_score, double next_score, int type);
-    inline void reject(int type);
-    void print() const;
-    
-    private:
-    constexpr static bool MAXIMIZE = true;
-    constexpr static int LOG_SIZE = 0xFFFF;
-    constexpr static int UPDATE_INTERVAL = 0xFF;
-    constexpr static double START_TEMP = 10000;
-    constexpr static double END_TEMP = 1e-9;
-    double time_limit;
-    double temp_ratio;
-    double log_probability[LOG_SIZE + 1];
-    long long iteration = 0;
-    long long accepted = 0;
-    long long rejected = 0;
-    map<int, long long> accepted_map;
-    map<int, long long> rejected_map;
-    double time = 0;
-    double temp = START_TEMP;
-    timer sa_timer;
-};
-
-simulated_annealing::simulated_annealing(double time_limit) : time_limit(time_limit) {
-    temp_ratio = (END_TEMP - START_TEMP) / time_limit;
-    sa_timer.start();
-    for (int i = 0; i <= LOG_SIZE; i++) log_probability[i] = log(random::probability());
-}
-
-inline bool simulated_annealing::end() {
-    iteration++;
-    if ((iteration & UPDATE_INTERVAL) == 0) {
-        time = sa_timer.get_time();
-        temp = START_TEMP + temp_ratio * time;
-        return time >= time_limit;
-    } else {
-        return false;
-    }
-}
-
-inline bool simulated_annealing::accept(double current_score, double next_score, int type) {
-    double diff = (MAXIMIZE ? next_score - current_score : current_score - next_score);
-    if (diff >= 0 || diff > log_probability[random::get_fast(LOG_SIZE)] * temp) {
-        accepted++;
-        accepted_map[type]++;
-
-        return true;
-    } else {
-        rejected++;
-        rejected_map[type]++;
-        return false;
-    }
-}
+const double START_TEMP = 10000;
+const double END_TEMP = 1e-9;
 
-inline void simulated_annealing::reject(int type) {
-    rejected++;
-    rejected_map[type]++;
-}
-
-void simulated_annealing::print() const {
-    fprintf(stderr, "iteration: %lld\n", iteration);
-    fprintf(stderr, "accepted: %lld\n", accepted);
-    for (auto& e: accepted_map) {
-        fprintf(stderr, "\taccepted-%d: %lld\n", e.first, e.second);        
-    }
-    fprintf(stderr, "rejected: %lld\n", rejected);
-    for (auto& e: rejected_map) {
-        fprintf(stderr, "\trejected-%d: %lld\n", e.first, e.second);        
-    }
+// START_TEMP から END_TEMP へ線形に冷やす。SA_* 環境変数で上書きできる (library/simulated_annealing.h)
+sa::schedule sa_schedule(double time_limit) {
+    return sa::schedule(time_limit, START_TEMP, END_TEMP).override_from_env();
 }
 
 const double INIT_TIME_LIMIT = 20;
 const double MAIN_TIME_LIMIT = 30;
-const int MAX_MUSICIAN = 1500;
-const int MAX_ATTENDEE = 5000;
 const double RADIUS = 10;
 const double RADIUS2 = RADIUS * RADIUS;
 const double BLOCK_RADIUS = 5;
@@ -164,12 +76,13 @@ double stage_top;
 double max_diff_width;
 double max_diff_height;
 vector<geo::P> placements;
-vector<pair<double, int>> attendee_angles[MAX_MUSICIAN];
-vector<int> blocked_attendees[MAX_MUSICIAN][MAX_MUSICIAN];
-int blocked_count[MAX_MUSICIAN][MAX_ATTENDEE];
-vector<pair<double, int>> tmp_attendee_angles[MAX_MUSICIAN];
-vector<int> tmp_blocked_attendees[MAX_MUSICIAN][MAX_MUSICIAN];
-int tmp_blocked_count[MAX_MUSICIAN][MAX_ATTENDEE];
+vector<manarimo::angular_index> attendee_angles;
+vector<manarimo::blocked_row> blocked_attendees;
+vector<vector<int>> blocked_count;
+// tmp_* は動いた演奏家の分だけ calc_blocked_one で確保される
+vector<manarimo::angular_index> tmp_attendee_angles;
+vector<manarimo::blocked_row> tmp_blocked_attendees;
+vector<vector<int>> tmp_blocked_count;
 vector<geo::P> best_placements;
 
 void input() {
@@ -184,16 +97,30 @@ void input() {
     stage_top = stage_bottom + problem.stage_height;
     stage_bottom += RADIUS;
     stage_top -= RADIUS;
+
+    // 状態は問題の大きさに合わせて確保する
+    const int n_musician = problem.musicians.size();
+    const int n_attendee = problem.attendees.size();
+    attendee_angles.assign(n_musician, manarimo::angular_index());
+    for (manarimo::angular_index& index : attendee_angles) index.init(problem.attendee_x_data, problem.attendee_y_data, n_attendee);
+    blocked_attendees.assign(n_musician, manarimo::blocked_row(n_musician));
+    blocked_count.assign(n_musician, vector<int>(n_attendee));
+    tmp_attendee_angles = attendee_angles;
+    tmp_blocked_attendees.assign(n_musician, manarimo::blocked_row());
+    tmp_blocked_count.assign(n_musician, vector<int>());
 }
 
 void output(const vector<geo::P>& placements) {
-    manarimo::print_solution(std::cout, manarimo::solution_t(placements));
+    manarimo::print_solution(std::cout, placements);
 }
 
 void store_to_file(const vector<geo::P>& placements, const string file_name) {
-    std::ofstream ofs(file_name);
-
-    manarimo::print_solution(ofs, manarimo::solution_t(placements));
+    static string buffer;
+    static vector<double> volumes;
+    volumes.assign(placements.size(), 1.);
+    if (!manarimo::store_solution(file_name, placements, volumes, buffer)) {
+        cerr << "failed to store " << file_name << endl;
+    }
 }
 
 double dist2(const geo::P& p1, const geo::P& p2) {
@@ -206,83 +133,67 @@ double dist(const geo::P& p1, const geo::P& p2) {
 
 void random_init() {
     placements.clear();
+    manarimo::spatial_grid grid(stage_left, stage_bottom, stage_right - stage_left, stage_top - stage_bottom, RADIUS);
     for (int i = 0; i < problem.musicians.size(); i++) {
         while (true) {
             geo::P p(random::get(stage_left, stage_right), random::get(stage_bottom, stage_top));
-            bool ng = false;
-            for (int j = 0; j < i; j++) {
-                if (dist2(placements[j], p) < RADIUS2) {
-                    ng = true;
-                    break;
-                }
-            }
-            if (!ng) {
+            if (!grid.collides(p, RADIUS2)) {
                 placements.push_back(p);
+                grid.insert(i, p);
                 break;
             }
         }
     }
 }
 
-double get_angle(const geo::P& p1, const geo::P& p2) {
-    return atan2(p2.Y - p1.Y, p2.X - p1.X);
-}
-
-void calc_blocked_one(int musician, const geo::P& p, vector<pair<double, int>>& attendee_angles, vector<int>* blocked_attendees, int* blocked_count, const vector<geo::P>& current_placements) {
-    attendee_angles.clear();
-    for (int i = 0; i < problem.attendees.size(); i++) {
-        double angle = get_angle(p, problem.attendees[i].pos);
-        attendee_angles.emplace_back(angle, i);
-        attendee_angles.emplace_back(angle + M_PI * 2, i);
-    }
-    sort(attendee_angles.begin(), attendee_angles.end());
+// previous は p の近くから見た並び (あれば並べ直しが速くなる)
+void calc_blocked_one(int musician, const geo::P& p, manarimo::angular_index& attendee_angles, const manarimo::angular_index& previous, manarimo::blocked_row& blocked_attendees, vector<int>& blocked_count, const vector<geo::P>& current_placements) {
+    attendee_angles.build_from(previous, p.X, p.Y);
     
-    for (int i = 0; i < problem.musicians.size(); i++) blocked_attendees[i].clear();
-    for (int i = 0; i < problem.attendees.size(); i++) blocked_count[i] = 0;
-    for (int i = 0; i < problem.musicians.size(); i++) {
-        if (i == musician) continue;
-        double angle = get_angle(p, current_placements[i]);
-        double offset = asin(BLOCK_RADIUS / dist(p, current_placements[i]));
-        double start = angle - offset;
-        double end = angle + offset;
-        if (start < -M_PI) {
-            start += M_PI * 2;
-            end += M_PI * 2;
-        }
-        int index = lower_bound(attendee_angles.begin(), attendee_angles.end(), make_pair(start, -1)) - attendee_angles.begin();
-        for (; index < attendee_angles.size(); index++) {
-            if (attendee_angles[index].first > end) break;
-            blocked_attendees[i].push_back(attendee_angles[index].second);
-            blocked_count[attendee_angles[index].second]++;
-        }
-    }
+    blocked_attendees.reset(problem.musicians.size());
+    blocked_count.assign(problem.attendees.size(), 0);
+    attendee_angles.for_each_blocked(current_placements.data(), current_placements.size(), BLOCK_RADIUS, [&](int i, int attendee) {
+        if (i == musician) return;
+        blocked_attendees.push_back(i, attendee);
+        blocked_count[attendee]++;
+    });
 }
 
 void calc_blocked() {
-    for (int i = 0; i < problem.musicians.size(); i++) calc_blocked_one(i, placements[i], attendee_angles[i], blocked_attendees[i], blocked_count[i], placements);
+    for (int i = 0; i < problem.musicians.size(); i++) calc_blocked_one(i, placements[i], attendee_angles[i], attendee_angles[i], blocked_attendees[i], blocked_count[i], placements);
 }
 
 double calc_one_score(const geo::P& p1, const geo::P& p2, double taste) {
     return ceil(1000000 * taste / dist2(p1, p2));
 }
 
+// tastes は problem.tastes_by_instrument の1行
+double calc_one_score(const geo::P& p, int attendee, const double* tastes) {
+    double dx = p.X - problem.attendee_x_data[attendee];
+    double dy = p.Y - problem.attendee_y_data[attendee];
+    return ceil(1000000 * tastes[attendee] / (dx * dx + dy * dy));
+}
+
 double score_all() {
     calc_blocked();
     double sum = 0;
     for (int i = 0; i < problem.musicians.size(); i++) {
+        const double* tastes = problem.tastes_by_instrument[problem.musicians[i]];
         for (int j = 0; j < problem.attendees.size(); j++) {
-            if (blocked_count[i][j] == 0) sum += calc_one_score(placements[i], problem.attendees[j].pos, problem.attendees[j].tastes[problem.musicians[i]]);
+            if (blocked_count[i][j] == 0) sum += calc_one_score(placements[i], j, tastes);
         }
     }
     return sum;
 }
 
 double score_one_no_block(const geo::P& p, int musician) {
-    double sum = 0;
-    for (const manarimo::atendee_t& a : problem.attendees) {
-        sum += calc_one_score(p, a.pos, a.tastes[musician]);
-    }
-    return sum;
+    return manarimo::no_block_impact(problem.attendee_x_data, problem.attendee_y_data, problem.attendees.size(), p.X, p.Y, problem.tastes_by_instrument[musician]);
+}
+
+// p にいる演奏家の楽器が musician1 だったときと musician2 だったときの score_one_no_block を out[0], out[1] に入れる
+void score_two_no_block(const geo::P& p, int musician1, int musician2, double* out) {
+    const double* tastes[2] = {problem.tastes_by_instrument[musician1], problem.tastes_by_instrument[musician2]};
+    manarimo::no_block_impacts<2>(problem.attendee_x_data, problem.attendee_y_data, problem.attendees.size(), p.X, p.Y, tastes, out);
 }
 
 double score_all_no_block() {
@@ -332,7 +243,7 @@ void sa_no_block() {
     double current_score = best_score;
     
     int unchanged = 0;
-    simulated_annealing sa(INIT_TIME_LIMIT);
+    sa::simulated_annealing sa(sa_schedule(INIT_TIME_LIMIT));
     while (!sa.end()) {
         unchanged++;
         if (unchanged == 10000) {
@@ -375,10 +286,13 @@ void sa_no_block() {
             int m2 = random::get(problem.musicians.size() - 1);
             if (m2 >= m1) m2++;
             double next_score = current_score;
-            next_score -= score_one_no_block(placements[m1], problem.musicians[m1]);
-            next_score -= score_one_no_block(placements[m2], problem.musicians[m2]);
-            next_score += score_one_no_block(placements[m1], problem.musicians[m2]);
-            next_score += score_one_no_block(placements[m2], problem.musicians[m1]);
+            double impact1[2], impact2[2];
+            score_two_no_block(placements[m1], problem.musicians[m1], problem.musicians[m2], impact1);
+            score_two_no_block(placements[m2], problem.musicians[m2], problem.musicians[m1], impact2);
+            next_score -= impact1[0];
+            next_score -= impact2[0];
+            next_score += impact1[1];
+            next_score += impact2[1];
             if (sa.accept(current_score, next_score, 1)) {
                 current_score = next_score;
                 swap(placements[m1], placements[m2]);
@@ -414,29 +328,40 @@ string get_prob_name(string s) {
     return s.substr(si, ei - si);
 }
 
-set<int> move(vector<geo::P>& placements, int idx, double dx, double dy) {
-    set<int> moved;
-    map<int, geo::P> to_move;
-    to_move[idx] = geo::P(dx, dy);
+// 1提案ごとの作業領域。move の連鎖リストと moved はここから取る
+manarimo::arena move_arena;
+
+struct push_t {
+    int m;
+    double dx;
+    double dy;
+};
+
+// 押し出しの連鎖で動いた演奏家を moved に昇順で入れる。失敗したら moved を空にして返す
+void move(vector<geo::P>& placements, int idx, double dx, double dy, manarimo::arena_vector<int>& moved) {
+    manarimo::arena_vector<push_t> to_move(move_arena);
+    manarimo::arena_vector<push_t> next_to_move(move_arena);
+    to_move.push_back({idx, dx, dy});
 
     for (int i = 0; i < 1000 && to_move.size() > 0; i++) {
         if (i == 999) {
             cerr << "Chaos move!" << endl;
-            return set<int>();
+            moved.clear();
+            return;
         }
-        map<int, geo::P> next_to_move;
-        for (auto iter = to_move.begin(); iter != to_move.end(); ++iter) {
-            int m = iter->first;
-            placements[m].first += iter->second.first;
-            placements[m].second += iter->second.second;
-            if (placements[m].first < stage_left) { return set<int>(); }
-            if (placements[m].first > stage_right) { return set<int>(); }
-            if (placements[m].second < stage_bottom) { return set<int>(); }
-            if (placements[m].second > stage_top) { return set<int>(); }
-            moved.insert(m);
+        next_to_move.clear();
+        for (const push_t& push : to_move) {
+            int m = push.m;
+            placements[m].first += push.dx;
+            placements[m].second += push.dy;
+            if (placements[m].first < stage_left || placements[m].first > stage_right || placements[m].second < stage_bottom || placements[m].second > stage_top) {
+                moved.clear();
+                return;
+            }
+            if (!moved.contains(m)) moved.push_back(m);
         }
-        for (auto iter = to_move.begin(); iter != to_move.end(); ++iter) {
-            int m = iter->first;
+        for (const push_t& push : to_move) {
+            int m = push.m;
             for (int i = 0; i < placements.size(); i++) {
                 if (i == m) continue;
                 if (dist2(placements[i], placements[m]) < RADIUS2) {
@@ -451,13 +376,20 @@ set<int> move(vector<geo::P>& placements, int idx, double dx, double dy) {
                         dx2 *= RADIUS / d;
                         dy2 *= RADIUS / d;
                     }
-                    next_to_move[i] = geo::P(next_to_move[i].first + dx2, next_to_move[i].second + dy2);
+                    push_t* next = find_if(next_to_move.begin(), next_to_move.end(), [i](const push_t& p) { return p.m == i; });
+                    if (next == next_to_move.end()) {
+                        next_to_move.push_back({i, 0, 0});
+                        next = next_to_move.end() - 1;
+                    }
+                    next->dx += dx2;
+                    next->dy += dy2;
                 }
             }
         }
-        to_move = next_to_move;
+        sort(next_to_move.begin(), next_to_move.end(), [](const push_t& a, const push_t& b) { return a.m < b.m; });
+        to_move.swap(next_to_move);
     }
-    return moved;
+    sort(moved.begin(), moved.end());
 }
 
 // g++ -std=c++2a -O3 kawatea_random.cpp
@@ -497,8 +429,9 @@ int main(int argc, char *argv[]) {
         double current_score = best_score;
         
         int unchanged = 0;
-        vector<vector<pair<int, int>>> new_blocked(MAX_MUSICIAN);
-        simulated_annealing sa(MAIN_TIME_LIMIT);
+        vector<vector<pair<int, int>>> new_blocked(problem.musicians.size());
+        vector<geo::P> next_placements = placements;
+        sa::simulated_annealing sa(sa_schedule(MAIN_TIME_LIMIT));
         while (!sa.end()) {
             unchanged++;
             if (unchanged == 10000) {
@@ -514,8 +447,10 @@ int main(int argc, char *argv[]) {
                 double theta = random::get_double(0, 2 * M_PI);
                 double dx = clamp(r * cos(theta), stage_left - _current_p.X, stage_right - _current_p.X);
                 double dy = clamp(r * sin(theta), stage_bottom - _current_p.Y, stage_top - _current_p.Y);
-                vector<geo::P> next_placements = placements;
-                set<int> moved = move(next_placements, _m, dx, dy);
+                move_arena.reset();
+                next_placements.assign(placements.begin(), placements.end());
+                manarimo::arena_vector<int> moved(move_arena);
+                move(next_placements, _m, dx, dy, moved);
                 if (moved.size() == 0) continue;
                 //if (moved.size() != 1) continue;
                 double next_score = current_score;
@@ -523,68 +458,53 @@ int main(int argc, char *argv[]) {
                 // 稼いでいたスコアが消える
                 for (int i = 0; i < problem.attendees.size(); i++) {
                     for (int m : moved) {
-                        if (blocked_count[m][i] == 0) next_score -= calc_one_score(placements[m], problem.attendees[i].pos, problem.attendees[i].tastes[problem.musicians[m]]);
+                        if (blocked_count[m][i] == 0) next_score -= calc_one_score(placements[m], i, problem.tastes_by_instrument[problem.musicians[m]]);
                     }
                 }
                 
                 // ブロックが消えることによるスコア
                 for (int i = 0; i < problem.musicians.size(); i++) {
-                    if (moved.count(i)) continue;
+                    if (moved.contains(i)) continue;
                     for (int m : moved) {
                         for (int j : blocked_attendees[i][m]) {
                             blocked_count[i][j]--;
-                            if (blocked_count[i][j] == 0) next_score += calc_one_score(placements[i], problem.attendees[j].pos, problem.attendees[j].tastes[problem.musicians[i]]);
+                            if (blocked_count[i][j] == 0) next_score += calc_one_score(placements[i], j, problem.tastes_by_instrument[problem.musicians[i]]);
                         }
                     }
                 }
                 
                 // 移動した演奏家がブロックされる聴衆を計算 & スコア計算
                 for (int m : moved) {
-                    calc_blocked_one(m, next_placements[m], tmp_attendee_angles[m], tmp_blocked_attendees[m], tmp_blocked_count[m], next_placements);
+                    calc_blocked_one(m, next_placements[m], tmp_attendee_angles[m], attendee_angles[m], tmp_blocked_attendees[m], tmp_blocked_count[m], next_placements);
                     for (int i = 0; i < problem.attendees.size(); i++) {
-                        if (tmp_blocked_count[m][i] == 0) next_score += calc_one_score(next_placements[m], problem.attendees[i].pos, problem.attendees[i].tastes[problem.musicians[m]]);
+                        if (tmp_blocked_count[m][i] == 0) next_score += calc_one_score(next_placements[m], i, problem.tastes_by_instrument[problem.musicians[m]]);
                     }
                 }
                 
                 // 移動先でブロックする聴衆を計算
-                set<pair<int,int>> new_blocked2;
+                // blocked_count は採用時に足す分をここで先に足しておき、同じ聴衆を二重に引かないようにする
                 for (int m : moved) {
                     new_blocked[m].clear();
                     for (int i = 0; i < problem.musicians.size(); i++) {
-                        if (moved.count(i)) continue;
-                        double angle = get_angle(placements[i], next_placements[m]);
-                        double offset = asin(BLOCK_RADIUS / dist(placements[i], next_placements[m]));
-                        double start = angle - offset;
-                        double end = angle + offset;
-                        if (start < -M_PI) {
-                            start += M_PI * 2;
-                            end += M_PI * 2;
-                        }
-                        int index = lower_bound(attendee_angles[i].begin(), attendee_angles[i].end(), make_pair(start, -1)) - attendee_angles[i].begin();
-                        for (; index < attendee_angles[i].size(); index++) {
-                            if (attendee_angles[i][index].first > end) break;
-                            int attendee = attendee_angles[i][index].second;
+                        if (moved.contains(i)) continue;
+                        attendee_angles[i].for_each_blocked(next_placements[m].X - placements[i].X, next_placements[m].Y - placements[i].Y, BLOCK_RADIUS, [&](int attendee) {
                             new_blocked[m].emplace_back(i, attendee);
-                            if (blocked_count[i][attendee] == 0 && new_blocked2.count(make_pair(i, attendee)) == 0) next_score -= calc_one_score(placements[i], problem.attendees[attendee].pos, problem.attendees[attendee].tastes[problem.musicians[i]]);
-                            new_blocked2.insert(make_pair(i, attendee));
-                        }
+                            if (blocked_count[i][attendee]++ == 0) next_score -= calc_one_score(placements[i], attendee, problem.tastes_by_instrument[problem.musicians[i]]);
+                        });
                     }
                 }
                 if (sa.accept(current_score, next_score, MOVE)) {
                     current_score = next_score;
                     for (int m : moved) {
                         placements[m] = next_placements[m];
-                        swap(attendee_angles[m], tmp_attendee_angles[m]);
-                        for (int i = 0; i < problem.musicians.size(); i++) swap(blocked_attendees[m][i], tmp_blocked_attendees[m][i]);
-                        for (int i = 0; i < problem.attendees.size(); i++) blocked_count[m][i] = tmp_blocked_count[m][i];
+                        attendee_angles[m].swap(tmp_attendee_angles[m]);
+                        blocked_attendees[m].swap(tmp_blocked_attendees[m]);
+                        blocked_count[m].swap(tmp_blocked_count[m]);
                         for (int i = 0; i < problem.musicians.size(); i++) {
-                            if (moved.count(i)) continue;
-                            blocked_attendees[i][m].clear();
-                        }
-                        for (const pair<int, int>& p : new_blocked[m]) {
-                            blocked_attendees[p.first][m].push_back(p.second);
-                            blocked_count[p.first][p.second]++;
+                            if (moved.contains(i)) continue;
+                            blocked_attendees[i].clear(m);
                         }
+                        for (const pair<int, int>& p : new_blocked[m]) blocked_attendees[p.first].push_back(m, p.second);
                     }
                     if (current_score > best_score) {
                         best_score = current_score;
@@ -594,9 +514,10 @@ int main(int argc, char *argv[]) {
                 } else {
                     for (int m : moved) {
                         for (int i = 0; i < problem.musicians.size(); i++) {
-                            if (moved.count(i)) continue;
+                            if (moved.contains(i)) continue;
                             for (int j : blocked_attendees[i][m]) blocked_count[i][j]++;
                         }
+                        for (const pair<int, int>& p : new_blocked[m]) blocked_count[p.first][p.second]--;
                     }
                 }
             } else if (random::get(100) < 95) {
@@ -607,14 +528,13 @@ int main(int argc, char *argv[]) {
                     double next_score = current_score;
                     for (int i = 0; i < problem.attendees.size(); i++) {
                         if (blocked_count[m1][i] == 0 || blocked_count[m2][i] == 0) {
-                            geo::P p = problem.attendees[i].pos;
                             if (blocked_count[m1][i] == 0) {
-                                next_score -= calc_one_score(placements[m1], p, problem.attendees[i].tastes[problem.musicians[m1]]);
-                                next_score += calc_one_score(placements[m1], p, problem.attendees[i].tastes[problem.musicians[m2]]);
+                                next_score -= calc_one_score(placements[m1], i, problem.tastes_by_instrument[problem.musicians[m1]]);
+                                next_score += calc_one_score(placements[m1], i, problem.tastes_by_instrument[problem.musicians[m2]]);
                             }
                             if (blocked_count[m2][i] == 0) {
-                                next_score -= calc_one_score(placements[m2], p, problem.attendees[i].tastes[problem.musicians[m2]]);
-                                next_score += calc_one_score(placements[m2], p, problem.attendees[i].tastes[problem.musicians[m1]]);
+                                next_score -= calc_one_score(placements[m2], i, problem.tastes_by_instrument[problem.musicians[m2]]);
+                                next_score += calc_one_score(placements[m2], i, problem.tastes_by_instrument[problem.musicians[m1]]);
                             }
                         }
                     }
@@ -622,13 +542,9 @@ int main(int argc, char *argv[]) {
                         current_score = next_score;
                         swap(placements[m1], placements[m2]);
                         attendee_angles[m1].swap(attendee_angles[m2]);
-                        for (int i = 0; i < problem.musicians.size(); i++) {
-                            if (i == m1 || i == m2) continue;
-                            blocked_attendees[i][m1].swap(blocked_attendees[i][m2]);
-                            blocked_attendees[m1][i].swap(blocked_attendees[m2][i]);
-                        }
-                        blocked_attendees[m1][m2].swap(blocked_attendees[m2][m1]);
-                        for (int i = 0; i < problem.attendees.size(); i++) swap(blocked_count[m1][i], blocked_count[m2][i]);
+                        blocked_attendees[m1].swap(blocked_attendees[m2]);
+                        for (int i = 0; i < problem.musicians.size(); i++) blocked_attendees[i].swap_columns(m1, m2);
+                        blocked_count[m1].swap(blocked_count[m2]);
                         if (current_score > best_score) {
                             best_score = current_score;
                             save_best_state();
@@ -648,18 +564,17 @@ int main(int argc, char *argv[]) {
                     double next_score = current_score;
                     for (int i = 0; i < problem.attendees.size(); i++) {
                         if (blocked_count[m1][i] == 0 || blocked_count[m2][i] == 0 || blocked_count[m3][i] == 0) {
-                            geo::P p = problem.attendees[i].pos;
                             if (blocked_count[m1][i] == 0) {
-                                next_score -= calc_one_score(placements[m1], p, problem.attendees[i].tastes[problem.musicians[m1]]);
-                                next_score += calc_one_score(placements[m1], p, problem.attendees[i].tastes[problem.musicians[m3]]);
+                                next_score -= calc_one_score(placements[m1], i, problem.tastes_by_instrument[problem.musicians[m1]]);
+                                next_score += calc_one_score(placements[m1], i, problem.tastes_by_instrument[problem.musicians[m3]]);
                             }
                             if (blocked_count[m2][i] == 0) {
-                                next_score -= calc_one_score(placements[m2], p, problem.attendees[i].tastes[problem.musicians[m2]]);
-                                next_score += calc_one_score(placements[m2], p, problem.attendees[i].tastes[problem.musicians[m1]]);
+                                next_score -= calc_one_score(placements[m2], i, problem.tastes_by_instrument[problem.musicians[m2]]);
+                                next_score += calc_one_score(placements[m2], i, problem.tastes_by_instrument[problem.musicians[m1]]);
                             }
                             if (blocked_count[m3][i] == 0) {
-                                next_score -= calc_one_score(placements[m3], p, problem.attendees[i].tastes[problem.musicians[m3]]);
-                                next_score += calc_one_score(placements[m3], p, problem.attendees[i].tastes[problem.musicians[m2]]);
+                                next_score -= calc_one_score(placements[m3], i, problem.tastes_by_instrument[problem.musicians[m3]]);
+                                next_score += calc_one_score(placements[m3], i, problem.tastes_by_instrument[problem.musicians[m2]]);
                             }
                         }
                     }
@@ -669,23 +584,15 @@ int main(int argc, char *argv[]) {
                         swap(placements[m2], placements[m3]);
                         attendee_angles[m1].swap(attendee_angles[m2]);
                         attendee_angles[m2].swap(attendee_angles[m3]);
+                        // 行も列も placements と同じ順で入れ替える
+                        blocked_attendees[m1].swap(blocked_attendees[m2]);
+                        blocked_attendees[m2].swap(blocked_attendees[m3]);
                         for (int i = 0; i < problem.musicians.size(); i++) {
-                            if (i == m1 || i == m2 || i == m3) continue;
-                            blocked_attendees[i][m1].swap(blocked_attendees[i][m2]);
-                            blocked_attendees[i][m2].swap(blocked_attendees[i][m3]);
-                            blocked_attendees[m1][i].swap(blocked_attendees[m2][i]);
-                            blocked_attendees[m2][i].swap(blocked_attendees[m3][i]);
-                        }
-                        // blocked_attendees[m1][m2].swap(blocked_attendees[m2][m1]);
-                        blocked_attendees[m1][m2].swap(blocked_attendees[m2][m3]);
-                        blocked_attendees[m2][m3].swap(blocked_attendees[m3][m1]);
-
-                        blocked_attendees[m2][m1].swap(blocked_attendees[m3][m2]);
-                        blocked_attendees[m3][m2].swap(blocked_attendees[m1][m3]);
-                        for (int i = 0; i < problem.attendees.size(); i++) {
-                            swap(blocked_count[m1][i], blocked_count[m2][i]);
-                            swap(blocked_count[m2][i], blocked_count[m3][i]);
+                            blocked_attendees[i].swap_columns(m1, m2);
+                            blocked_attendees[i].swap_columns(m2, m3);
                         }
+                        blocked_count[m1].swap(blocked_count[m2]);
+                        blocked_count[m2].swap(blocked_count[m3]);
                         if (current_score > best_score) {
                             best_score = current_score;
                             save_best_state();
@@ -704,14 +611,13 @@ int main(int argc, char *argv[]) {
                     double next_score = current_score;
                     for (int i = 0; i < problem.attendees.size(); i++) {
                         if (blocked_count[m1][i] == 0 || blocked_count[m2][i] == 0) {
-                            geo::P p = problem.attendees[i].pos;
                             if (blocked_count[m1][i] == 0) {
-                                next_score -= calc_one_score(placements[m1], p, problem.attendees[i].tastes[problem.musicians[m1]]);
-                                next_score += calc_one_score(placements[m1], p, problem.attendees[i].tastes[problem.musicians[m2]]);
+                                next_score -= calc_one_score(placements[m1], i, problem.tastes_by_instrument[problem.musicians[m1]]);
+                                next_score += calc_one_score(placements[m1], i, problem.tastes_by_instrument[problem.musicians[m2]]);
                             }
                             if (blocked_count[m2][i] == 0) {
-                                next_score -= calc_one_score(placements[m2], p, problem.attendees[i].tastes[problem.musicians[m2]]);
-                                next_score += calc_one_score(placements[m2], p, problem.attendees[i].tastes[problem.musicians[m1]]);
+                                next_score -= calc_one_score(placements[m2], i, problem.tastes_by_instrument[problem.musicians[m2]]);
+                                next_score += calc_one_score(placements[m2], i, problem.tastes_by_instrument[problem.musicians[m1]]);
                             }
                         }
                     }
@@ -731,13 +637,9 @@ int main(int argc, char *argv[]) {
                     current_score = next_score_cand;
                     swap(placements[m1], placements[m2]);
                     attendee_angles[m1].swap(attendee_angles[m2]);
-                    for (int i = 0; i < problem.musicians.size(); i++) {
-                        if (i == m1 || i == m2) continue;
-                        blocked_attendees[i][m1].swap(blocked_attendees[i][m2]);
-                        blocked_attendees[m1][i].swap(blocked_attendees[m2][i]);
-                    }
-                    blocked_attendees[m1][m2].swap(blocked_attendees[m2][m1]);
-                    for (int i = 0; i < problem.attendees.size(); i++) swap(blocked_count[m1][i], blocked_count[m2][i]);
+                    blocked_attendees[m1].swap(blocked_attendees[m2]);
+                    for (int i = 0; i < problem.musicians.size(); i++) blocked_attendees[i].swap_columns(m1, m2);
+                    blocked_count[m1].swap(blocked_count[m2]);
                     if (current_score > best_score) {
                         best_score = current_score;
                         save_best_state();